@@ -0,0 +1,292 @@
+#include <printccy/printccy.h>
+#include <marrow/marrow.h>
+
+#define RIPPLE_BACKEND RIPPLE_EMPTY
+#define RIPPLE_IMPLEMENTATION
+#include <ripple/ripple.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_WIDTH 1920
+#define BENCH_HEIGHT 1080
+
+static u32 bench_frame;
+
+static u64 bench_time_ns(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+static void bench_element(u64 id, RippleElementConfig config)
+{
+    ripple_push_id(id);
+    ripple_submit_element(config);
+}
+
+static void bench_leaf(u64 id, RippleElementConfig config)
+{
+    bench_element(id, config);
+    ripple_pop_id();
+}
+
+// one element per level, each a bit smaller than its parent, also a stack depth stress test
+static u32 build_deep(u32 n_elements)
+{
+    for (u32 i = 0; i < n_elements; i++)
+    {
+        bench_element(i + 1, (RippleElementConfig){
+            FORM( .width = PERCENT(0.99f, SVT_RELATIVE_PARENT), .height = PERCENT(0.99f, SVT_RELATIVE_PARENT), .x = PIXELS(1) ),
+            RECTANGLE( .color = RIPPLE_RGB(0x222831) )
+        });
+    }
+    for (u32 i = 0; i < n_elements; i++)
+        ripple_pop_id();
+    return n_elements;
+}
+
+// a single row of GROW cells with staggered minimum widths sharing the free space
+static u32 build_wide(u32 n_elements)
+{
+    bench_element(1, (RippleElementConfig){
+        FORM( .width = PIXELS((i32)n_elements * 16), .height = PIXELS(32), .direction = cld_HORIZONTAL )
+    });
+    for (u32 i = 1; i < n_elements; i++)
+    {
+        bench_leaf(i + 1, (RippleElementConfig){
+            FORM( .width = GROW, .height = GROW, .min_width = PIXELS(i % 16) ),
+            RECTANGLE( .color = RIPPLE_RGB(0x393E46) )
+        });
+    }
+    ripple_pop_id();
+    return n_elements;
+}
+
+// containers sized by their children, BENCH_NESTED_FANOUT children per level
+#define BENCH_NESTED_FANOUT 8
+static u32 build_nested_level(u32 budget, u32 depth)
+{
+    u32 used = 0;
+    for (u32 i = 0; i < BENCH_NESTED_FANOUT && used < budget; i++)
+    {
+        used += 1;
+        u32 remaining = budget - used;
+        u32 child_budget = depth < 6 ? min(remaining, (budget - 1) / BENCH_NESTED_FANOUT) : 0;
+        if (child_budget == 0)
+        {
+            bench_leaf(i + 1, (RippleElementConfig){
+                FORM( .width = PIXELS(8 + i), .height = PIXELS(8) ),
+                RECTANGLE( .color = RIPPLE_RGB(0x00ADB5) )
+            });
+            continue;
+        }
+
+        bench_element(i + 1, (RippleElementConfig){
+            FORM( .width = PERCENT(1.0f, SVT_RELATIVE_CHILD), .height = PERCENT(1.0f, SVT_RELATIVE_CHILD), .direction = depth % 2 ? cld_VERTICAL : cld_HORIZONTAL )
+        });
+        used += build_nested_level(child_budget, depth + 1);
+        ripple_pop_id();
+    }
+    return used;
+}
+
+static u32 build_nested(u32 n_elements)
+{
+    u32 built = 0;
+    for (u64 id = 1; built < n_elements; id++)
+    {
+        bench_element(id, (RippleElementConfig){
+            FORM( .width = PERCENT(1.0f, SVT_RELATIVE_CHILD), .height = PERCENT(1.0f, SVT_RELATIVE_CHILD) )
+        });
+        built += 1 + build_nested_level(min(n_elements - built - 1, 4096u), 0);
+        ripple_pop_id();
+    }
+    return built;
+}
+
+// the nested tree with every chunk in a RIPPLE_MEMO, so after the first frame nothing is built again
+static u32 build_memo(u32 n_elements)
+{
+    u32 built = 0;
+    for (u64 id = 1; built < n_elements; id++)
+    {
+        u32 budget = min(n_elements - built - 1, 4096u);
+        u32 n_before = _ripple_context->current_window.elements.nodes.n_items;
+        RIPPLE_MEMO(id, budget)
+        {
+            bench_element(id, (RippleElementConfig){
+                FORM( .width = PERCENT(1.0f, SVT_RELATIVE_CHILD), .height = PERCENT(1.0f, SVT_RELATIVE_CHILD) )
+            });
+            build_nested_level(budget, 0);
+            ripple_pop_id();
+        }
+        built += _ripple_context->current_window.elements.nodes.n_items - n_before;
+    }
+    return built;
+}
+
+// the nested tree plus one cell that changes width every frame, so only part of the layout can be reused
+static u32 build_changing(u32 n_elements)
+{
+    u32 built = build_nested(n_elements - 1);
+    bench_leaf(U32_MAX, (RippleElementConfig){
+        FORM( .width = PIXELS((i32)(8 + bench_frame % 8)), .height = PIXELS(8) ),
+        RECTANGLE( .color = RIPPLE_RGB(0x00ADB5) )
+    });
+    return built + 1;
+}
+
+// groups of popups stacked with RIPPLE_RAISE so every element sorts onto one of several layers
+static u32 build_layered(u32 n_elements)
+{
+    u32 built = 0;
+    for (u64 id = 1; built < n_elements; id++)
+    {
+        // spread the groups over a handful of base layers
+        _ripple_context->current_window.current_layer = (u8)(id % 8);
+        RIPPLE_RAISE()
+        {
+            for (u32 i = 0; i < 8 && built < n_elements; i++, built++)
+            {
+                if (i % 2)
+                {
+                    RIPPLE_RAISE()
+                        bench_leaf(id * 8 + i, (RippleElementConfig){
+                            .layer = _ripple_context->current_window.current_layer,
+                            FORM( .width = PIXELS(20), .height = PIXELS(20), .x = PIXELS((i32)(id % BENCH_WIDTH)), .y = PIXELS((i32)(i * 10)) ),
+                            RECTANGLE( .color = RIPPLE_RGB(0xEEEEEE) )
+                        });
+                }
+                else
+                {
+                    bench_leaf(id * 8 + i, (RippleElementConfig){
+                        .layer = _ripple_context->current_window.current_layer,
+                        FORM( .width = PIXELS(20), .height = PIXELS(20), .x = PIXELS((i32)(id % BENCH_WIDTH)), .y = PIXELS((i32)(i * 10)) ),
+                        RECTANGLE( .color = RIPPLE_RGB(0xEEEEEE) )
+                    });
+                }
+            }
+        }
+    }
+    _ripple_context->current_window.current_layer = 0;
+    return built;
+}
+
+// rows of cells that all read their state, like a table or a grid view with the cursor somewhere over it
+#define BENCH_GRID_COLUMNS 64
+static u32 build_interactive(u32 n_elements)
+{
+    u32 built = 0;
+    for (u64 row = 1; built < n_elements; row++)
+    {
+        bench_element(row, (RippleElementConfig){
+            FORM( .width = GROW, .height = PIXELS(16), .direction = cld_HORIZONTAL )
+        });
+        built++;
+        for (u32 column = 0; column < BENCH_GRID_COLUMNS && built < n_elements; column++, built++)
+        {
+            ripple_push_id(column + 1);
+            ripple_submit_element((RippleElementConfig){
+                FORM( .width = PIXELS(BENCH_WIDTH / BENCH_GRID_COLUMNS), .height = GROW ),
+                RECTANGLE( .color = STATE().hovered ? RIPPLE_RGB(0x00ADB5) : RIPPLE_RGB(0x393E46) )
+            });
+            ripple_pop_id();
+        }
+        ripple_pop_id();
+    }
+    return built;
+}
+
+STRUCT(BenchScenario) {
+    const char* name;
+    u32 (*build)(u32 n_elements);
+};
+
+static const BenchScenario scenarios[] = {
+    { "deep",    build_deep },
+    { "wide",    build_wide },
+    { "nested",  build_nested },
+    { "changing", build_changing },
+    { "memo",    build_memo },
+    { "layered", build_layered },
+    { "interactive", build_interactive },
+};
+
+STRUCT(BenchResult) {
+    u32 n_elements;
+    u64 build_ns;
+    u64 submit_ns;
+    RippleFrameStats stats; // of the fastest submit
+};
+
+static BenchResult bench_run(RippleContext* context, const BenchScenario* scenario, u32 n_elements, u32 n_frames)
+{
+    BenchResult best = { .build_ns = U64_MAX, .submit_ns = U64_MAX };
+
+    // the first frame creates element states and grows every buffer, it is not measured
+    for (u32 frame = 0; frame <= n_frames; frame++, bench_frame++)
+    {
+        u64 start = bench_time_ns();
+        best.n_elements = scenario->build(n_elements);
+        u64 built = bench_time_ns();
+        ripple_submit(context, BENCH_WIDTH, BENCH_HEIGHT, (RippleRenderData){ 0 });
+        u64 submitted = bench_time_ns();
+
+        if (frame == 0) continue;
+        best.build_ns = min(best.build_ns, built - start);
+        if (submitted - built < best.submit_ns)
+        {
+            best.submit_ns = submitted - built;
+            best.stats = context->stats;
+        }
+    }
+
+    return best;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* only = argc > 1 ? argv[1] : nullptr;
+    u32 max_elements = argc > 2 ? (u32)strtoul(argv[2], nullptr, 10) : 1000000;
+    u32 n_frames = argc > 3 ? (u32)strtoul(argv[3], nullptr, 10) : 5;
+
+    RippleContext context = ripple_initialize((RippleBackendRendererConfig){ 0 }, (RippleAllocatorConfig){ 0 });
+    context.collect_stats = true;
+    ripple_make_active_context(&context);
+
+    // somewhere over the middle of the screen, so hit testing has to look at every element
+    ripple_on_mouse_event(&context, (RippleMouseEvent){ .type = REVT_MOUSE_MOVE, .x = BENCH_WIDTH / 2, .y = BENCH_HEIGHT / 2 });
+
+    // build and submit are wall clock, the submit phases come from RippleFrameStats, all per element
+    printf("%-12s %10s %10s %10s | %8s %8s %8s %8s %8s | %8s %10s\n",
+           "scenario", "elements", "build", "submit", "layout", "sweep", "sort", "update", "render", "reused", "total ms");
+    for (u32 i = 0; i < array_len(scenarios); i++)
+    {
+        const BenchScenario* scenario = &scenarios[i];
+        if (only && strcmp(only, "all") != 0 && strcmp(only, scenario->name) != 0) continue;
+
+        for (u32 n = 1000; n <= max_elements; n *= 10)
+        {
+            BenchResult result = bench_run(&context, scenario, n, n_frames);
+            f64 n_elements = (f64)result.n_elements;
+            printf("%-12s %10u %10.2f %10.2f | %8.2f %8.2f %8.2f %8.2f %8.2f | %7.1f%% %10.3f\n",
+                   scenario->name,
+                   result.n_elements,
+                   (f64)result.build_ns / n_elements,
+                   (f64)result.submit_ns / n_elements,
+                   (f64)result.stats.layout_ns / n_elements,
+                   (f64)result.stats.state_sweep_ns / n_elements,
+                   (f64)result.stats.sort_ns / n_elements,
+                   (f64)result.stats.update_ns / n_elements,
+                   (f64)(result.stats.render_ns + result.stats.render_end_ns) / n_elements,
+                   100.0 * (f64)result.stats.n_reused_layouts / (f64)result.stats.n_elements,
+                   (f64)(result.build_ns + result.submit_ns) / 1e6);
+        }
+    }
+
+    return 0;
+}
@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include <glfw/glfw3.h>
 #include <glfw3webgpu.h>
 
@@ -434,6 +436,68 @@ Context create_context(WGPUDevice device, WGPUQueue queue)
     return ctx;
 }
 
+// --shader-paths draws every branch of ripple's fragment shader over the whole window in turn
+// and logs the frame time of each, so the branches can be checked by eye and compared
+typedef enum {
+    SHADER_PATH_PLAIN,
+    SHADER_PATH_GRADIENT,
+    SHADER_PATH_ATLAS,
+    SHADER_PATH_OWNED,
+    SHADER_PATH_TEXT,
+    SHADER_PATH_COUNT
+} ShaderPath;
+
+const char* shader_path_names[SHADER_PATH_COUNT] = { "plain", "rounded gradient", "atlas image", "owned image", "text" };
+
+#define SHADER_PATH_FRAMES 300
+#define SHADER_PATH_LAYERS 8 // full window quads stacked per frame so the fill dominates
+
+static void shader_path_layers(ShaderPath path, u32 depth, RippleImage atlas_image, RippleImage owned_image, str words)
+{
+    if (depth == 0) return;
+
+    switch (path)
+    {
+        case SHADER_PATH_PLAIN:
+            RIPPLE( FORM( .width = PERCENT(1.0f, SVT_RELATIVE_PARENT), .height = PERCENT(1.0f, SVT_RELATIVE_PARENT) ), RECTANGLE( .color = accent ) )
+                shader_path_layers(path, depth - 1, atlas_image, owned_image, words);
+            break;
+        case SHADER_PATH_GRADIENT:
+            RIPPLE( FORM( .width = PERCENT(1.0f, SVT_RELATIVE_PARENT), .height = PERCENT(1.0f, SVT_RELATIVE_PARENT) ), RECTANGLE( .color1 = dark, .color2 = accent, .color3 = light, .color4 = dark2, .radius = 32.0f ) )
+                shader_path_layers(path, depth - 1, atlas_image, owned_image, words);
+            break;
+        case SHADER_PATH_ATLAS:
+            RIPPLE( FORM( .width = PERCENT(1.0f, SVT_RELATIVE_PARENT), .height = PERCENT(1.0f, SVT_RELATIVE_PARENT) ), IMAGE( .image = atlas_image ) )
+                shader_path_layers(path, depth - 1, atlas_image, owned_image, words);
+            break;
+        case SHADER_PATH_OWNED:
+            RIPPLE( FORM( .width = PERCENT(1.0f, SVT_RELATIVE_PARENT), .height = PERCENT(1.0f, SVT_RELATIVE_PARENT) ), IMAGE( .image = owned_image ) )
+                shader_path_layers(path, depth - 1, atlas_image, owned_image, words);
+            break;
+        case SHADER_PATH_TEXT:
+            // text can't be stacked, one window of wrapped glyphs
+            RIPPLE( FORM( .width = PERCENT(1.0f, SVT_RELATIVE_PARENT), .height = PERCENT(1.0f, SVT_RELATIVE_PARENT) ) )
+                wrapped_text(words);
+            break;
+        default: break;
+    }
+}
+
+static RippleImage register_checker_image(u32 size, u32 cell)
+{
+    u8* pixels = malloc(size * size * 4);
+    for (u32 y = 0; y < size; y++)
+        for (u32 x = 0; x < size; x++)
+        {
+            u8 v = ((x / cell) ^ (y / cell)) & 1 ? 0xff : 0x40;
+            u8* p = &pixels[(y * size + x) * 4];
+            p[0] = v; p[1] = (u8)(x * 255 / size); p[2] = (u8)(y * 255 / size); p[3] = 0xff;
+        }
+    RippleImage image = ripple_wgpu_register_image(pixels, size, size);
+    free(pixels);
+    return image;
+}
+
 int main(int argc, char* argv[])
 {
     glfwInit();
@@ -441,12 +505,24 @@ int main(int argc, char* argv[])
 
     RippleBackendRendererConfig config = ripple_backend_renderer_default_config();
     WGPUSurface surface = glfwGetWGPUSurface(config.instance, window);
-    RippleContext ripple_context = ripple_initialize(config);
+    RippleContext ripple_context = ripple_initialize(config, (RippleAllocatorConfig){ 0 });
     ripple_make_active_context(&ripple_context);
     ripple_glfw_register_callbacks(&ripple_context, window);
 
     i32 prev_width = 0, prev_height = 0;
 
+    bool shader_paths = argc > 1 && strcmp(argv[1], "--shader-paths") == 0;
+    u32 shader_path_frame = 0;
+    f32 shader_path_time = 0.0f;
+    // one fits in the atlas, the other is over RIPPLE_WGPU_ATLAS_MAX_IMAGE_SIZE and gets a texture of its own
+    RippleImage atlas_image = register_checker_image(64, 8);
+    RippleImage owned_image = register_checker_image(512, 32);
+    char words_buffer[8192];
+    usize n_words = 0;
+    while (n_words + 64 < sizeof(words_buffer))
+        n_words += snprintf(words_buffer + n_words, sizeof(words_buffer) - n_words, "the quick brown fox jumps over the lazy dog %zu ", n_words);
+    str words = { words_buffer, n_words };
+
     Context ctx = create_context(config.device, config.queue);
 
     f32 prev_time = 0.0f;
@@ -498,7 +574,8 @@ int main(int argc, char* argv[])
                     .format = WGPUTextureFormat_BGRA8UnormSrgb,
                     .usage = WGPUTextureUsage_RenderAttachment,
                     .device = config.device,
-                    .presentMode = WGPUPresentMode_Fifo,
+                    // vsync would cap every shader path at the same frame time
+                    .presentMode = shader_paths ? WGPUPresentMode_Immediate : WGPUPresentMode_Fifo,
                     .alphaMode = WGPUCompositeAlphaMode_Auto
                 });
             if (ctx.depth.view) wgpuTextureViewRelease(ctx.depth.view);
@@ -525,7 +602,25 @@ int main(int argc, char* argv[])
             glm_mat4_copy(glms_mat4_mul(proj, view).raw, shader_data.camera_matrix); // cam.raw is plain mat4
         }
 
-        RIPPLE( FORM( .height = RELATIVE(1.0f, SVT_RELATIVE_CHILD), .width = RELATIVE(1.0f, SVT_RELATIVE_CHILD) ), RECTANGLE( .color = dark ) )
+        if (shader_paths)
+        {
+            ShaderPath path = shader_path_frame / SHADER_PATH_FRAMES;
+            if (path == SHADER_PATH_COUNT)
+                break;
+
+            // the first frames of a path warm up pipelines, bind groups and glyphs
+            if (shader_path_frame % SHADER_PATH_FRAMES >= SHADER_PATH_FRAMES / 4)
+                shader_path_time += dt;
+            if (++shader_path_frame % SHADER_PATH_FRAMES == 0)
+            {
+                mrw_debug("{}: {.3f} ms per frame", shader_path_names[path], shader_path_time * 1000.0f / (SHADER_PATH_FRAMES - SHADER_PATH_FRAMES / 4));
+                shader_path_time = 0.0f;
+            }
+
+            RIPPLE( FORM( .width = PIXELS(width), .height = PIXELS(height) ) )
+                shader_path_layers(path, SHADER_PATH_LAYERS, atlas_image, owned_image, words);
+        }
+        else RIPPLE( FORM( .height = RELATIVE(1.0f, SVT_RELATIVE_CHILD), .width = RELATIVE(1.0f, SVT_RELATIVE_CHILD) ), RECTANGLE( .color = dark ) )
         {
             text(mrw_format("fps rn is: {.2f}", &str_allocator, 1.0f / (dt_accum / dt_samples)));
 
@@ -645,4 +740,7 @@ int main(int argc, char* argv[])
 
         bump_allocator_reset(&str_allocator);
     }
+
+    ripple_wgpu_release_image(atlas_image);
+    ripple_wgpu_release_image(owned_image);
 }
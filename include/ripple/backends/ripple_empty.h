@@ -17,15 +17,20 @@ typedef u32 RippleImage;
 
 #ifdef RIPPLE_EMPTY_IMPLEMENTATION
 
-void ripple_backend_renderer_initialize(RippleBackendRendererConfig config) { }
+// counts what a real backend would have drawn so frame stats stay meaningful
+static u32 _ripple_empty_instance_count = 0;
 
-void ripple_backend_render_begin(u32 width, u32 height) { }
+void ripple_backend_renderer_initialize(RippleBackendRendererConfig config, Allocator* allocator) { }
+
+void ripple_backend_render_begin(u32 width, u32 height) { _ripple_empty_instance_count = 0; }
 
 void ripple_backend_render_end(RippleRenderData render_data, RippleColor clear_color) { }
 
-void ripple_backend_render_rect(i32 x, i32 y, i32 w, i32 h, RippleColor color1, RippleColor color2, RippleColor color3, RippleColor color4, f32 radius1, f32 radius2, f32 radius3, f32 radius4) { }
+u32 ripple_backend_instance_count(void) { return _ripple_empty_instance_count; }
+
+void ripple_backend_render_rect(i32 x, i32 y, i32 w, i32 h, RippleColor color1, RippleColor color2, RippleColor color3, RippleColor color4, f32 radius1, f32 radius2, f32 radius3, f32 radius4) { _ripple_empty_instance_count++; }
 
-void ripple_backend_render_image(i32 x, i32 y, i32 w, i32 h, RippleImage image) { }
+void ripple_backend_render_image(i32 x, i32 y, i32 w, i32 h, RippleImage image) { _ripple_empty_instance_count++; }
 
 void ripple_measure_text(str text, f32 font_size, i32* out_w, i32* out_h)
 {
@@ -33,7 +38,7 @@ void ripple_measure_text(str text, f32 font_size, i32* out_w, i32* out_h)
     *out_h = font_size;
 }
 
-void ripple_backend_render_text(i32 pos_x, i32 pos_y, str text, f32 font_size, RippleColor color) { }
+void ripple_backend_render_text(i32 pos_x, i32 pos_y, str text, f32 font_size, RippleColor color) { _ripple_empty_instance_count += str_len(text); }
 
 #endif // RIPPLE_WGPU_IMPLEMENTATION
 
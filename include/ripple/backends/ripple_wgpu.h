@@ -7,6 +7,7 @@
 
 #include "../vendor/stb/stb_truetype.h"
 
+#include <assert.h>
 #include <math.h>
 
 #include <webgpu/webgpu.h>
@@ -29,25 +30,91 @@ STRUCT(RippleRenderData) {
     WGPUTextureView texture_view;
 };
 
-typedef WGPUTextureView RippleImage;
+// a view and the part of it to draw, ripple_wgpu_image wraps a whole view
+STRUCT(RippleImage) {
+    WGPUTextureView view;
+    u16 uv[4]; // unorm16 min and max corner
+    u32 slot, generation; // of images registered into the atlas, generation 0 for every other image
+};
+
+// registered images up to this size share one atlas and are drawn in a single batch
+#ifndef RIPPLE_WGPU_ATLAS_SIZE
+#define RIPPLE_WGPU_ATLAS_SIZE 2048
+#endif // RIPPLE_WGPU_ATLAS_SIZE
+#ifndef RIPPLE_WGPU_ATLAS_MAX_IMAGE_SIZE
+#define RIPPLE_WGPU_ATLAS_MAX_IMAGE_SIZE 256
+#endif // RIPPLE_WGPU_ATLAS_MAX_IMAGE_SIZE
+
+// instances of this many frames stay untouched in the instance ring, the gpu may still be reading them
+#ifndef RIPPLE_WGPU_FRAMES_IN_FLIGHT
+#define RIPPLE_WGPU_FRAMES_IN_FLIGHT 3
+#endif // RIPPLE_WGPU_FRAMES_IN_FLIGHT
+
+// cached glyph runs not drawn in this many frames are dropped, a power of two
+#ifndef RIPPLE_WGPU_GLYPH_RUN_FRAMES
+#define RIPPLE_WGPU_GLYPH_RUN_FRAMES 64
+#endif // RIPPLE_WGPU_GLYPH_RUN_FRAMES
+
+// image bind groups are kept across frames, the least recently used one is released once this many exist
+#ifndef RIPPLE_WGPU_BIND_GROUP_CACHE_SIZE
+#define RIPPLE_WGPU_BIND_GROUP_CACHE_SIZE 64
+#endif // RIPPLE_WGPU_BIND_GROUP_CACHE_SIZE
+
+// totals since ripple_backend_renderer_initialize, in steady state only n_uploads and uploaded_bytes move
+STRUCT(RippleWGPUStats) {
+    u64 n_uploads; // instance uploads, at most one per frame
+    u64 uploaded_bytes;
+    u32 n_reallocations; // times the instance ring had to grow
+    u64 size; // current size of the instance ring in bytes
+    u32 n_bind_groups_created; // image bind groups that were not in the cache
+    u32 n_glyphs_rasterized; // glyphs drawn into the glyph atlas, again after an eviction
+    u32 n_glyphs_evicted; // glyph atlas shelves emptied to make room
+    u32 n_glyph_runs_built; // strings laid out glyph by glyph, every other draw copied a cached run
+};
+
+RippleWGPUStats ripple_wgpu_stats(void);
+
+RippleImage ripple_wgpu_image(WGPUTextureView view);
 
+// copies width * height RGBA8 pixels into the atlas, or into a texture of its own when they don't fit
+RippleImage ripple_wgpu_register_image(const u8* pixels, u32 width, u32 height);
+
+// frees what ripple_wgpu_register_image made and drops every cached bind group that uses the view.
+// call it before releasing a view of your own that was drawn
+void ripple_wgpu_release_image(RippleImage image);
+
+// define RIPPLE_WGPU_SDF_FONT to rasterize glyphs as signed distance fields, one small atlas then serves every text size
+#ifdef RIPPLE_WGPU_SDF_FONT
+const f32 FONT_SIZE = 48.0f;
+const u32 BITMAP_SIZE = 512;
+#ifndef RIPPLE_WGPU_SDF_PADDING
+#define RIPPLE_WGPU_SDF_PADDING 4 // texels of distance around every glyph
+#endif // RIPPLE_WGPU_SDF_PADDING
+#ifndef RIPPLE_WGPU_SDF_SCALE
+#define RIPPLE_WGPU_SDF_SCALE 32 // a texel of distance in 1/255ths, the edge is at 128. pasted into the shader as SDF_SCALE
+#endif // RIPPLE_WGPU_SDF_SCALE
+#else
 const f32 FONT_SIZE = 128.0f;
 const u32 BITMAP_SIZE = 1024;
+#endif // RIPPLE_WGPU_SDF_FONT
 
 #ifdef RIPPLE_WGPU_IMPLEMENTATION
 
+// everything but the rectangle itself is packed and unpacked again in vs_main
 STRUCT(RippleWGPUInstance) {
     f32 pos[2];
     f32 size[2];
-    f32 uv[4];
-    f32 radius[4];
-    f32 color1[4];
-    f32 color2[4];
-    f32 color3[4];
-    f32 color4[4];
-    u32 image_index;
-    u32 image_index_padding[3];
+    u16 uv[4]; // unorm16
+    u16 radius[4]; // unorm16, relative to the smaller side
+    u32 colors[4]; // RGBA8 with red in the lowest byte
+    u32 flags; // the low byte is the texture binding + 1, 0 draws without a texture
 };
+// the vertex attributes of the pipeline and the shader unpacking both assume this layout
+_Static_assert(sizeof(RippleWGPUInstance) == 52, "RippleWGPUInstance no longer matches the vertex layout");
+
+// expands a macro into a string literal, for constants the shader shares with the code
+#define _RIPPLE_WGPU_STRINGIFY_(x) #x
+#define _RIPPLE_WGPU_STRINGIFY(x) _RIPPLE_WGPU_STRINGIFY_(x)
 
 const char* shader =
 "struct ShaderData {\n"
@@ -60,16 +127,14 @@ const char* shader =
 "@group(1) @binding(3) var texture4: texture_2d<f32>;\n"
 "@group(1) @binding(4) var texture5: texture_2d<f32>;\n"
 "@group(2) @binding(0) var texture_sampler: sampler;\n"
+"@group(2) @binding(1) var font_sampler: sampler;\n"
 "struct InstanceInput {\n"
 "    @location(1) position: vec2f,\n"
 "    @location(2) size: vec2f,\n"
-"    @location(3) uv: vec4f,\n"
-"    @location(4) radius: vec4f,\n"
-"    @location(5) color1: vec4f,\n"
-"    @location(6) color2: vec4f,\n"
-"    @location(7) color3: vec4f,\n"
-"    @location(8) color4: vec4f,\n"
-"    @location(9) image_index: u32,\n"
+"    @location(3) uv: vec2u,\n"
+"    @location(4) radius: vec2u,\n"
+"    @location(5) colors: vec4u,\n"
+"    @location(6) flags: u32,\n"
 "}\n"
 "struct VertexOutput{\n"
 "    @builtin(position) position: vec4f,\n"
@@ -91,16 +156,32 @@ const char* shader =
 "    position = position / resolution;\n"
 "    position = vec2f(position.x, 1.0f - position.y) * 2.0f - vec2<f32>(1.0f, 1.0f);\n"
 "    var out: VertexOutput;\n"
-"    out.uv = vec2(select(i.uv.x, i.uv.z, p.x > 0.5), select(i.uv.y, i.uv.w, p.y > 0.5));\n"
+"    let uv = vec4f(unpack2x16unorm(i.uv.x), unpack2x16unorm(i.uv.y));\n"
+"    out.uv = vec2(select(uv.x, uv.z, p.x > 0.5), select(uv.y, uv.w, p.y > 0.5));\n"
 "    out.size = i.size;\n"
-"    out.radius = i.radius;\n"
-"    out.color1 = i.color1; out.color2 = i.color2; out.color3 = i.color3; out.color4 = i.color4;\n"
+"    out.radius = vec4f(unpack2x16unorm(i.radius.x), unpack2x16unorm(i.radius.y));\n"
+"    out.color1 = unpack4x8unorm(i.colors.x); out.color2 = unpack4x8unorm(i.colors.y);\n"
+"    out.color3 = unpack4x8unorm(i.colors.z); out.color4 = unpack4x8unorm(i.colors.w);\n"
 "    out.position = vec4(position, 0.0, 1.0);\n"
-"    out.image_index = i.image_index;\n"
+"    out.image_index = i.flags & 0xffu;\n"
 "    return out;\n"
 "}\n"
+#ifdef RIPPLE_WGPU_SDF_FONT
+"const SDF_SCALE = f32(" _RIPPLE_WGPU_STRINGIFY(RIPPLE_WGPU_SDF_SCALE) ");\n"
+"fn font_coverage(uv: vec2f, uv_per_pixel: vec2f) -> f32 {\n"
+"    let texels = (textureSampleLevel(texture2, font_sampler, uv, 0.0f).r * 255.0f - 128.0f) / SDF_SCALE;\n"
+"    let texels_per_pixel = max(uv_per_pixel.x, uv_per_pixel.y) * f32(textureDimensions(texture2).x);\n"
+"    return clamp(texels / max(texels_per_pixel, 0.0001f) + 0.5f, 0.0f, 1.0f);\n"
+"}\n"
+#else
+"fn font_coverage(uv: vec2f, uv_per_pixel: vec2f) -> f32 {\n"
+"    return textureSampleLevel(texture2, texture_sampler, uv, 0.0f).r;\n"
+"}\n"
+#endif // RIPPLE_WGPU_SDF_FONT
 "@fragment\n"
 "fn fs_main(in: VertexOutput) -> @location(0) vec4f {\n"
+"    // derivatives have to be taken before branching on image_index\n"
+"    let uv_per_pixel = fwidth(in.uv);\n"
 "    var alpha = 1.0f;\n"
 "    let min_size = min(in.size.x, in.size.y);\n"
 "    let p = in.uv * in.size;\n"
@@ -126,19 +207,15 @@ const char* shader =
 "        let a = 1.0f - smoothstep(0.0f, feather, distance(p, cTL) - rTL);\n"
 "        alpha = min(alpha, a);\n"
 "    }\n"
-"    var tc1 = textureSample(texture1, texture_sampler, in.uv);\n"
-"    var tc2 = vec4f(textureSample(texture2, texture_sampler, in.uv).r);\n"
-"    var tc3 = textureSample(texture3, texture_sampler, in.uv);\n"
-"    var tc4 = textureSample(texture4, texture_sampler, in.uv);\n"
-"    var tc5 = textureSample(texture5, texture_sampler, in.uv);\n"
-"    var tc: vec4f;\n"
+"    // image_index is the same for the whole quad, so only one texture is ever fetched and plain rects fetch none\n"
+"    var tc = vec4f(1.0f);\n"
 "    switch in.image_index {\n"
-"        default { tc = tc1; }\n"
-"        case 0u { tc = tc1; }\n"
-"        case 1u { tc = tc2; }\n"
-"        case 2u { tc = tc3; }\n"
-"        case 3u { tc = tc4; }\n"
-"        case 4u { tc = tc5; }\n"
+"        case 1u { tc = textureSampleLevel(texture1, texture_sampler, in.uv, 0.0f); }\n"
+"        case 2u { tc = vec4f(font_coverage(in.uv, uv_per_pixel)); }\n"
+"        case 3u { tc = textureSampleLevel(texture3, texture_sampler, in.uv, 0.0f); }\n"
+"        case 4u { tc = textureSampleLevel(texture4, texture_sampler, in.uv, 0.0f); }\n"
+"        case 5u { tc = textureSampleLevel(texture5, texture_sampler, in.uv, 0.0f); }\n"
+"        default { }\n"
 "    }\n"
 "    let gradient = mix(mix(in.color3, in.color4, in.uv.x), mix(in.color1, in.color2, in.uv.x), in.uv.y);\n"
 "    let color = tc * gradient;\n"
@@ -151,9 +228,62 @@ STRUCT(RippleWGPUShaderData) {
 };
 
 STRUCT(_RippleImageInstancePair) {
-    RippleImage images[5];
+    WGPUTextureView images[5];
     u32 n_images;
-    u32 instance_index;
+    u32 instance_index; // first instance drawn with these images
+};
+
+STRUCT(_RippleBindGroupCacheEntry) {
+    WGPUTextureView images[5];
+    WGPUBindGroup bind_group;
+    u32 last_used; // frame
+};
+
+// a row of the atlas, images are placed left to right and the row is reused once all of them are released.
+// an emptied row merges with the empty rows next to it and is split again for images of another height
+STRUCT(_RippleAtlasShelf) {
+    u32 y, height; // height 0 for entries merged away, they are reused for new shelves
+    u32 x;
+    u32 n_images;
+};
+
+// where a registered image lives, the handle's generation has to match for a release to count
+STRUCT(_RippleAtlasSlot) {
+    u32 shelf;
+    u32 generation; // bumped on release, so releasing twice does nothing
+};
+
+// a glyph's metrics stay once looked up, its bitmap only while its shelf of the glyph atlas isn't evicted
+STRUCT(_RippleGlyph) {
+    i32 index; // in the font
+    f32 advance;
+    i16 x0, y0; // bitmap offset from the pen
+    u16 w, h;
+    u16 x, y; // in the glyph atlas
+    u32 shelf; // U32_MAX while not in the glyph atlas
+    u32 shelf_generation; // the bitmap is gone once the shelf's generation moves past it
+};
+
+STRUCT(_RippleGlyphShelf) {
+    u32 y, height;
+    u32 x;
+    u32 last_used; // frame
+    u32 generation; // bumped on eviction, instead of finding every glyph that was on the shelf
+};
+
+// a string drawn before, its instances are positioned relative to the pen and only need moving
+STRUCT(_RippleGlyphRun) {
+    u32 first, n_instances; // in the current glyph run pool
+    u32 text_first, text_size; // in the current text pool, keys that collide are told apart by the text and font size
+    f32 font_size;
+    u32 generation; // of the glyph atlas, the uvs are stale once it moves on
+    u64 shelves; // a bit per glyph atlas shelf the run uses, they are touched whenever it is drawn
+    u32 last_used; // frame
+};
+
+STRUCT(_RippleOwnedImage) {
+    WGPUTexture texture;
+    WGPUTextureView view;
 };
 
 struct {
@@ -165,55 +295,123 @@ struct {
     WGPURenderPipeline pipeline;
 
     WGPUSampler sampler;
+    WGPUSampler font_sampler;
     WGPUBindGroupLayout sampler_bind_group_layout;
     WGPUBindGroup sampler_bind_group;
 
     struct {
         WGPUTexture texture;
         WGPUTextureView view;
-    } white_pixel;
-
+        VEKTOR(_RippleAtlasShelf) shelves;
+        u32 height; // taken by shelves, from the top
+        VEKTOR(_RippleAtlasSlot) slots;
+        VEKTOR(u32) free_slots;
+    } atlas;
+    VEKTOR(_RippleOwnedImage) owned_images; // registered images that didn't fit the atlas
+
+    // glyphs are rasterized the first time they are drawn, when the atlas is full the least recently used shelf goes
     struct {
         WGPUTexture texture;
         WGPUTextureView view;
-        stbtt_bakedchar glyphs[96];
+        stbtt_fontinfo info;
+        u8* file; // info points into it
+        f32 scale; // font units to FONT_SIZE pixels
+        f32 ascii_advances[128]; // so measuring ASCII never looks up a glyph, zero for control characters
+        MAPA(u64, u32) glyph_map; // codepoint -> glyphs
+        VEKTOR(_RippleGlyph) glyphs;
+        VEKTOR(_RippleGlyphShelf) shelves;
+        u32 height; // taken by shelves, from the top
+        u32 generation; // bumped whenever a shelf is evicted
+        u8* bitmap; // scratch for rasterizing, fits the font's bounding box
+        u32 bitmap_size;
     } font;
 
-    WGPUBuffer instance_buffer;
+    // keyed by text, font size and color
+    struct {
+        MAPA(u64, _RippleGlyphRun) map;
+        VEKTOR(RippleWGPUInstance) pools[2]; // live runs are compacted into the other one once most of this one is dead
+        VEKTOR(char) texts[2]; // compacted together with pools
+        u32 pool;
+        u32 n_live; // instances that belong to a run in the map
+        u32 n_live_text; // bytes of texts that belong to a run in the map
+    } glyph_runs;
+
+    // every frame writes its instances into the next free slice and never waits on older frames
+    struct {
+        WGPUBuffer buffer;
+        u64 size;
+        u64 head;
+        struct { u64 offset, size; } frames[RIPPLE_WGPU_FRAMES_IN_FLIGHT]; // slices of the last frames, indexed by frame
+        u32 frame;
+    } ring;
+
     WGPUBuffer uniform_buffer;
     WGPUBindGroup bind_group;
 
     RippleWGPUShaderData shader_data;
+    RippleWGPUStats stats;
+    u32 frame;
 
-    u32 instance_buffer_size;
     VEKTOR(RippleWGPUInstance) instances;
     VEKTOR( _RippleImageInstancePair ) images;
+    VEKTOR(_RippleBindGroupCacheEntry) bind_group_cache;
 } _context;
 
-void ripple_backend_renderer_initialize(RippleBackendRendererConfig config)
+void ripple_backend_renderer_initialize(RippleBackendRendererConfig config, Allocator* allocator)
 {
     mrw_debug("INITIALIZNG BACKEND");
 
+    vektor_init(_context.instances, 0, allocator);
+    vektor_init(_context.images, 0, allocator);
+    vektor_init(_context.bind_group_cache, RIPPLE_WGPU_BIND_GROUP_CACHE_SIZE, allocator);
+    vektor_init(_context.atlas.shelves, 0, allocator);
+    vektor_init(_context.atlas.slots, 0, allocator);
+    vektor_init(_context.atlas.free_slots, 0, allocator);
+    vektor_init(_context.owned_images, 0, allocator);
+
     // create font
     {
-        // load data
+        // load data, stb_truetype reads from it for as long as the font is used
         FILE* file = fopen("./res/roboto.ttf", "rb");
         if (!file) mrw_abort("Could not load font file :(");
         fseek(file, 0, SEEK_END);
         const usize file_size = ftell(file);
         rewind(file);
-        u8 file_buffer[file_size];
-        buf_set(file_buffer, 0, file_size);
-        fread(file_buffer, 1, file_size, file);
+        _context.font.file = malloc(file_size);
+        fread(_context.font.file, 1, file_size, file);
         fclose(file);
 
-        // bake bitmap
-        u8 bitmap_buffer[BITMAP_SIZE * BITMAP_SIZE];
-        if (stbtt_BakeFontBitmap(file_buffer, 0, FONT_SIZE, bitmap_buffer, BITMAP_SIZE, BITMAP_SIZE, 32, 96, _context.font.glyphs) == 0)
+        mapa_init(_context.glyph_runs.map, mapa_hash_u64, mapa_cmp_bytes, allocator);
+        vektor_init(_context.glyph_runs.pools[0], 0, allocator);
+        vektor_init(_context.glyph_runs.pools[1], 0, allocator);
+        vektor_init(_context.glyph_runs.texts[0], 0, allocator);
+        vektor_init(_context.glyph_runs.texts[1], 0, allocator);
+
+        if (!stbtt_InitFont(&_context.font.info, _context.font.file, stbtt_GetFontOffsetForIndex(_context.font.file, 0)))
+        {
+            mrw_abort("failed loading font");
+        }
+        _context.font.scale = stbtt_ScaleForPixelHeight(&_context.font.info, FONT_SIZE);
+        for (u32 c = 32; c < array_len(_context.font.ascii_advances); c++)
         {
-            mrw_abort("failed baking bitmap");
+            i32 advance, left_side_bearing;
+            stbtt_GetCodepointHMetrics(&_context.font.info, (i32)c, &advance, &left_side_bearing);
+            _context.font.ascii_advances[c] = (f32)advance * _context.font.scale;
         }
 
+        mapa_init(_context.font.glyph_map, mapa_hash_u64, mapa_cmp_bytes, allocator);
+        vektor_init(_context.font.glyphs, 0, allocator);
+        vektor_init(_context.font.shelves, 0, allocator);
+
+        i32 x0, y0, x1, y1;
+        stbtt_GetFontBoundingBox(&_context.font.info, &x0, &y0, &x1, &y1);
+        f32 margin = 4.0f;
+#ifdef RIPPLE_WGPU_SDF_FONT
+        margin += 2.0f * RIPPLE_WGPU_SDF_PADDING;
+#endif // RIPPLE_WGPU_SDF_FONT
+        _context.font.bitmap_size = (u32)(((x1 - x0) * _context.font.scale + margin) * ((y1 - y0) * _context.font.scale + margin));
+        _context.font.bitmap = malloc(_context.font.bitmap_size);
+
         _context.font.texture = wgpuDeviceCreateTexture(config.device, &(WGPUTextureDescriptor){
                 .label = WEBGPU_STR("fontAtlas"),
                 .size = (WGPUExtent3D){ .width = BITMAP_SIZE, .height = BITMAP_SIZE, .depthOrArrayLayers = 1 },
@@ -224,23 +422,6 @@ void ripple_backend_renderer_initialize(RippleBackendRendererConfig config)
                 .sampleCount = 1
             });
 
-        wgpuQueueWriteTexture(config.queue, &(WGPUTexelCopyTextureInfo){
-                .texture = _context.font.texture,
-                .aspect = WGPUTextureAspect_All
-            },
-            bitmap_buffer,
-            BITMAP_SIZE * BITMAP_SIZE,
-            &(WGPUTexelCopyBufferLayout){
-                .bytesPerRow = BITMAP_SIZE,
-                .rowsPerImage = BITMAP_SIZE
-            },
-            &(WGPUExtent3D){
-                .width = BITMAP_SIZE,
-                .height = BITMAP_SIZE,
-                .depthOrArrayLayers = 1
-            }
-        );
-
         _context.font.view = wgpuTextureCreateView(_context.font.texture, &(WGPUTextureViewDescriptor){
                 .format = WGPUTextureFormat_R8Unorm,
                 .dimension = WGPUTextureViewDimension_2D,
@@ -251,9 +432,9 @@ void ripple_backend_renderer_initialize(RippleBackendRendererConfig config)
     }
 
     {
-        _context.white_pixel.texture = wgpuDeviceCreateTexture(config.device, &(WGPUTextureDescriptor){
-                .label = WEBGPU_STR("white_pixel"),
-                .size = (WGPUExtent3D){ .width = 1, .height = 1, .depthOrArrayLayers = 1 },
+        _context.atlas.texture = wgpuDeviceCreateTexture(config.device, &(WGPUTextureDescriptor){
+                .label = WEBGPU_STR("image_atlas"),
+                .size = (WGPUExtent3D){ .width = RIPPLE_WGPU_ATLAS_SIZE, .height = RIPPLE_WGPU_ATLAS_SIZE, .depthOrArrayLayers = 1 },
                 .format = WGPUTextureFormat_RGBA8Unorm,
                 .usage = WGPUTextureUsage_TextureBinding | WGPUTextureUsage_CopyDst,
                 .dimension = WGPUTextureDimension_2D,
@@ -261,31 +442,13 @@ void ripple_backend_renderer_initialize(RippleBackendRendererConfig config)
                 .sampleCount = 1
             });
 
-        _context.white_pixel.view = wgpuTextureCreateView(_context.white_pixel.texture, &(WGPUTextureViewDescriptor){
+        _context.atlas.view = wgpuTextureCreateView(_context.atlas.texture, &(WGPUTextureViewDescriptor){
                 .format = WGPUTextureFormat_RGBA8Unorm,
                 .dimension = WGPUTextureViewDimension_2D,
                 .mipLevelCount = 1,
                 .arrayLayerCount = 1,
                 .aspect = WGPUTextureAspect_All,
             });
-
-        u32 white = 0xffffffff;
-        wgpuQueueWriteTexture(config.queue, &(WGPUTexelCopyTextureInfo){
-                .texture = _context.white_pixel.texture,
-                .aspect = WGPUTextureAspect_All
-            },
-            &white,
-            4,
-            &(WGPUTexelCopyBufferLayout){
-                .bytesPerRow = 4,
-                .rowsPerImage = 1
-            },
-            &(WGPUExtent3D){
-                .width = 1,
-                .height = 1,
-                .depthOrArrayLayers = 1
-            }
-        );
     }
 
     _context.bind_group_layout = wgpuDeviceCreateBindGroupLayout(config.device, &(WGPUBindGroupLayoutDescriptor){
@@ -315,10 +478,11 @@ void ripple_backend_renderer_initialize(RippleBackendRendererConfig config)
                     },
                 },
                 [1] = {
+                    // the font, sampled linearly when it is a distance field
                     .binding = 1,
                     .visibility = WGPUShaderStage_Fragment,
                     .texture = {
-                        .sampleType = WGPUTextureSampleType_UnfilterableFloat,
+                        .sampleType = WGPUTextureSampleType_Float,
                         .viewDimension = WGPUTextureViewDimension_2D,
                     },
                 },
@@ -351,12 +515,21 @@ void ripple_backend_renderer_initialize(RippleBackendRendererConfig config)
 
     _context.sampler_bind_group_layout = wgpuDeviceCreateBindGroupLayout(config.device, &(WGPUBindGroupLayoutDescriptor)
         {
-            .entryCount = 1,
-            .entries = &(WGPUBindGroupLayoutEntry) {
-                .binding = 0,
-                .visibility = WGPUShaderStage_Fragment,
-                .sampler = {
-                    .type = WGPUSamplerBindingType_NonFiltering
+            .entryCount = 2,
+            .entries = (WGPUBindGroupLayoutEntry[]) {
+                [0] = {
+                    .binding = 0,
+                    .visibility = WGPUShaderStage_Fragment,
+                    .sampler = {
+                        .type = WGPUSamplerBindingType_NonFiltering
+                    }
+                },
+                [1] = {
+                    .binding = 1,
+                    .visibility = WGPUShaderStage_Fragment,
+                    .sampler = {
+                        .type = WGPUSamplerBindingType_Filtering
+                    }
                 }
             }
         });
@@ -371,13 +544,27 @@ void ripple_backend_renderer_initialize(RippleBackendRendererConfig config)
             .maxAnisotropy = 1
         });
 
+    _context.font_sampler = wgpuDeviceCreateSampler(config.device, &(WGPUSamplerDescriptor){
+            .addressModeU = WGPUAddressMode_ClampToEdge,
+            .addressModeV = WGPUAddressMode_ClampToEdge,
+            .addressModeW = WGPUAddressMode_ClampToEdge,
+            .magFilter = WGPUFilterMode_Linear,
+            .minFilter = WGPUFilterMode_Linear,
+            .mipmapFilter = WGPUMipmapFilterMode_Nearest,
+            .maxAnisotropy = 1
+        });
+
     _context.sampler_bind_group = wgpuDeviceCreateBindGroup(config.device, &(WGPUBindGroupDescriptor){
             .layout = _context.sampler_bind_group_layout,
-            .entryCount = 1,
+            .entryCount = 2,
             .entries = (WGPUBindGroupEntry[]){
                 [0] = {
                     .binding = 0,
                     .sampler = _context.sampler
+                },
+                [1] = {
+                    .binding = 1,
+                    .sampler = _context.font_sampler
                 }
             }
         });
@@ -406,7 +593,7 @@ void ripple_backend_renderer_initialize(RippleBackendRendererConfig config)
                 .bufferCount = 1,
                 .buffers = (WGPUVertexBufferLayout[]) {
                     {
-                        .attributeCount = 9,
+                        .attributeCount = 6,
                         .attributes = (WGPUVertexAttribute[]) { {
                                 .shaderLocation = 1,
                                 .format = WGPUVertexFormat_Float32x2,
@@ -419,38 +606,23 @@ void ripple_backend_renderer_initialize(RippleBackendRendererConfig config)
                             },
                             {
                                 .shaderLocation = 3,
-                                .format = WGPUVertexFormat_Float32x4,
+                                .format = WGPUVertexFormat_Uint32x2,
                                 .offset = offsetof(RippleWGPUInstance, uv)
                             },
                             {
                                 .shaderLocation = 4,
-                                .format = WGPUVertexFormat_Float32x4,
+                                .format = WGPUVertexFormat_Uint32x2,
                                 .offset = offsetof(RippleWGPUInstance, radius)
                             },
                             {
                                 .shaderLocation = 5,
-                                .format = WGPUVertexFormat_Float32x4,
-                                .offset = offsetof(RippleWGPUInstance, color1)
+                                .format = WGPUVertexFormat_Uint32x4,
+                                .offset = offsetof(RippleWGPUInstance, colors)
                             },
                             {
                                 .shaderLocation = 6,
-                                .format = WGPUVertexFormat_Float32x4,
-                                .offset = offsetof(RippleWGPUInstance, color2)
-                            },
-                            {
-                                .shaderLocation = 7,
-                                .format = WGPUVertexFormat_Float32x4,
-                                .offset = offsetof(RippleWGPUInstance, color3)
-                            },
-                            {
-                                .shaderLocation = 8,
-                                .format = WGPUVertexFormat_Float32x4,
-                                .offset = offsetof(RippleWGPUInstance, color4)
-                            },
-                            {
-                                .shaderLocation = 9,
                                 .format = WGPUVertexFormat_Uint32,
-                                .offset = offsetof(RippleWGPUInstance, image_index)
+                                .offset = offsetof(RippleWGPUInstance, flags)
                             }
                         },
                         .arrayStride = sizeof(RippleWGPUInstance),
@@ -509,64 +681,406 @@ void ripple_backend_renderer_initialize(RippleBackendRendererConfig config)
     _context.config = config;
 }
 
+static void _ripple_backend_sweep_glyph_runs(void)
+{
+    for (i32 run_i = 0; run_i < (i64)_context.glyph_runs.map.size; run_i++)
+    {
+        _RippleGlyphRun* run = mapa_get_at_index(_context.glyph_runs.map, (u64)run_i);
+        if (!run) continue;
+        if (_context.frame - run->last_used >= RIPPLE_WGPU_GLYPH_RUN_FRAMES || run->generation != _context.font.generation)
+        {
+            _context.glyph_runs.n_live -= run->n_instances;
+            _context.glyph_runs.n_live_text -= run->text_size;
+            mapa_remove_at_index(_context.glyph_runs.map, (u64)run_i);
+            run_i--;
+        }
+    }
+
+    typeof(_context.glyph_runs.pools[0])* pool = &_context.glyph_runs.pools[_context.glyph_runs.pool];
+    typeof(_context.glyph_runs.texts[0])* texts = &_context.glyph_runs.texts[_context.glyph_runs.pool];
+    if (pool->n_items <= 2 * _context.glyph_runs.n_live + 4096 && texts->n_items <= 2 * _context.glyph_runs.n_live_text + 4096) return;
+
+    typeof(_context.glyph_runs.pools[0])* compacted = &_context.glyph_runs.pools[!_context.glyph_runs.pool];
+    typeof(_context.glyph_runs.texts[0])* compacted_texts = &_context.glyph_runs.texts[!_context.glyph_runs.pool];
+    vektor_clear(*compacted);
+    vektor_clear(*compacted_texts);
+    for (u64 run_i = 0; run_i < _context.glyph_runs.map.size; run_i++)
+    {
+        _RippleGlyphRun* run = mapa_get_at_index(_context.glyph_runs.map, run_i);
+        if (!run) continue;
+        _ripple_vektor_reserve(*compacted, run->n_instances);
+        if (run->n_instances) buf_copy(compacted->items + compacted->n_items, pool->items + run->first, run->n_instances * sizeof(*pool->items));
+        run->first = compacted->n_items;
+        compacted->n_items += run->n_instances;
+
+        _ripple_vektor_reserve(*compacted_texts, run->text_size);
+        if (run->text_size) buf_copy(compacted_texts->items + compacted_texts->n_items, texts->items + run->text_first, run->text_size);
+        run->text_first = compacted_texts->n_items;
+        compacted_texts->n_items += run->text_size;
+    }
+    _context.glyph_runs.pool = !_context.glyph_runs.pool;
+}
+
 void ripple_backend_render_begin(u32 width, u32 height)
 {
     _context.shader_data.resolution[0] = width;
     _context.shader_data.resolution[1] = height;
     wgpuQueueWriteBuffer(_context.config.queue, _context.uniform_buffer, 0, &_context.shader_data, sizeof(_context.shader_data));
+    if ((++_context.frame & (RIPPLE_WGPU_GLYPH_RUN_FRAMES - 1)) == 0)
+        _ripple_backend_sweep_glyph_runs();
     vektor_clear(_context.instances);
     vektor_clear(_context.images);
     vektor_add(_context.images, (_RippleImageInstancePair) {
-        .images = { [0] = _context.white_pixel.view, [1] = _context.font.view },
+        .images = { [0] = _context.atlas.view, [1] = _context.font.view },
         .n_images = 2,
         .instance_index = 0
     });
 }
 
-static void _ripple_backend_color_to_color(RippleColor color, f32 out_color[4])
+u32 ripple_backend_instance_count(void)
+{
+    return _context.instances.n_items;
+}
+
+// RGB is 0xRRGGBB and RGBA is 0xRRGGBBAA, the shader wants red in the lowest byte
+static u32 _ripple_backend_color_to_color(RippleColor color)
+{
+    u32 rgba = color.format == RCF_RGB ? (color.value << 8) | 0xff : color.value;
+    return (rgba >> 24) | ((rgba >> 8) & 0xff00) | ((rgba << 8) & 0xff0000) | (rgba << 24);
+}
+
+static u16 _ripple_backend_unorm16(f32 value)
+{
+    return (u16)(clamp(value, 0.0f, 1.0f) * 65535.0f + 0.5f);
+}
+
+// index of the lowest set bit, value can't be 0
+static inline u32 _ripple_backend_ctz64(u64 value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (u32)__builtin_ctzll(value);
+#else
+    u32 n = 0;
+    for (; !(value & 1); value >>= 1) n++;
+    return n;
+#endif
+}
+
+RippleWGPUStats ripple_wgpu_stats(void)
+{
+    return _context.stats;
+}
+
+RippleImage ripple_wgpu_image(WGPUTextureView view)
+{
+    return (RippleImage){ .view = view, .uv = { 0, 0, 0xffff, 0xffff } };
+}
+
+static void _ripple_backend_write_pixels(WGPUTexture texture, u32 x, u32 y, const u8* pixels, u32 width, u32 height, u32 pixel_size)
 {
-    if (color.format == RCF_RGB)
+    wgpuQueueWriteTexture(_context.config.queue, &(WGPUTexelCopyTextureInfo){
+            .texture = texture,
+            .origin = { .x = x, .y = y },
+            .aspect = WGPUTextureAspect_All
+        },
+        pixels,
+        width * height * pixel_size,
+        &(WGPUTexelCopyBufferLayout){
+            .bytesPerRow = width * pixel_size,
+            .rowsPerImage = height
+        },
+        &(WGPUExtent3D){
+            .width = width,
+            .height = height,
+            .depthOrArrayLayers = 1
+        }
+    );
+}
+
+static u32 _ripple_backend_atlas_add_shelf(u32 y, u32 height)
+{
+    for (u32 i = 0; i < _context.atlas.shelves.n_items; i++)
     {
-        out_color[0] = (f32)((color.value >> 16) & 0xff) / 255.0f;
-        out_color[1] = (f32)((color.value >> 8) & 0xff) / 255.0f;
-        out_color[2] = (f32)(color.value & 0xff) / 255.0f;
-        out_color[3] = 1.0f;
+        if (_context.atlas.shelves.items[i].height) continue;
+        _context.atlas.shelves.items[i] = (_RippleAtlasShelf){ .y = y, .height = height };
+        return i;
     }
-    else
+    vektor_add(_context.atlas.shelves, (_RippleAtlasShelf){ .y = y, .height = height });
+    return _context.atlas.shelves.n_items - 1;
+}
+
+// shelf packing, picks the lowest shelf the image fits without wasting more than half of it.
+// with no such shelf and no room below the others it splits the smallest empty shelf that is tall enough
+static bool _ripple_backend_atlas_place(u32 width, u32 height, u32* out_x, u32* out_y, u32* out_shelf)
+{
+    // a pixel of padding keeps neighbours from bleeding in
+    u32 padded_width = width + 1;
+    u32 padded_height = height + 1;
+
+    u32 best = U32_MAX;
+    u32 empty = U32_MAX;
+    for (u32 i = 0; i < _context.atlas.shelves.n_items; i++)
+    {
+        _RippleAtlasShelf* shelf = &_context.atlas.shelves.items[i];
+        if (shelf->height < padded_height) continue;
+        if (!shelf->n_images && (empty == U32_MAX || shelf->height < _context.atlas.shelves.items[empty].height)) empty = i;
+        if (shelf->height > padded_height * 2) continue;
+        if (shelf->x + padded_width > RIPPLE_WGPU_ATLAS_SIZE) continue;
+        if (best == U32_MAX || shelf->height < _context.atlas.shelves.items[best].height) best = i;
+    }
+
+    if (best == U32_MAX && _context.atlas.height + padded_height <= RIPPLE_WGPU_ATLAS_SIZE)
     {
-        out_color[0] = (f32)((color.value >> 24) & 0xff) / 255.0f;
-        out_color[1] = (f32)((color.value >> 16) & 0xff) / 255.0f;
-        out_color[2] = (f32)((color.value >> 8) & 0xff) / 255.0f;
-        out_color[3] = (f32)(color.value & 0xff) / 255.0f;
+        best = _ripple_backend_atlas_add_shelf(_context.atlas.height, padded_height);
+        _context.atlas.height += padded_height;
     }
+    else if (best == U32_MAX)
+    {
+        if (empty == U32_MAX) return false;
+        _RippleAtlasShelf split = _context.atlas.shelves.items[empty];
+        _context.atlas.shelves.items[empty].height = padded_height;
+        if (split.height > padded_height) _ripple_backend_atlas_add_shelf(split.y + padded_height, split.height - padded_height);
+        best = empty;
+    }
+
+    _RippleAtlasShelf* shelf = &_context.atlas.shelves.items[best];
+    *out_x = shelf->x;
+    *out_y = shelf->y;
+    *out_shelf = best;
+    shelf->x += padded_width;
+    shelf->n_images++;
+    return true;
 }
 
-void ripple_backend_render_end(RippleRenderData render_data, RippleColor clear_color)
+// an emptied shelf takes in its empty neighbours, there is at most one above and one below.
+// at the bottom its rows go back to the atlas
+static void _ripple_backend_atlas_merge(u32 shelf_i)
 {
-    if (!_context.instance_buffer || _context.instance_buffer_size < _context.instances.size)
+    _RippleAtlasShelf* shelf = &_context.atlas.shelves.items[shelf_i];
+    for (u32 i = 0; i < _context.atlas.shelves.n_items; i++)
+    {
+        _RippleAtlasShelf* other = &_context.atlas.shelves.items[i];
+        if (i == shelf_i || other->n_images || !other->height) continue;
+        if (other->y + other->height == shelf->y) shelf->y = other->y;
+        else if (shelf->y + shelf->height != other->y) continue;
+        shelf->height += other->height;
+        other->height = 0;
+    }
+
+    if (shelf->y + shelf->height == _context.atlas.height)
     {
-        _context.instance_buffer_size = _context.instances.size + 1;
+        _context.atlas.height = shelf->y;
+        shelf->height = 0;
+    }
+}
 
-        if (_context.instance_buffer)
+RippleImage ripple_wgpu_register_image(const u8* pixels, u32 width, u32 height)
+{
+    u32 x, y, shelf;
+    if (width <= RIPPLE_WGPU_ATLAS_MAX_IMAGE_SIZE && height <= RIPPLE_WGPU_ATLAS_MAX_IMAGE_SIZE && _ripple_backend_atlas_place(width, height, &x, &y, &shelf))
+    {
+        _ripple_backend_write_pixels(_context.atlas.texture, x, y, pixels, width, height, 4);
+
+        u32 slot;
+        if (_context.atlas.free_slots.n_items)
         {
-            wgpuBufferRelease(_context.instance_buffer);
+            slot = _context.atlas.free_slots.items[--_context.atlas.free_slots.n_items];
         }
+        else
+        {
+            slot = _context.atlas.slots.n_items;
+            vektor_add(_context.atlas.slots, (_RippleAtlasSlot){ .generation = 1 });
+        }
+        _context.atlas.slots.items[slot].shelf = shelf;
+
+        return (RippleImage){
+            .view = _context.atlas.view,
+            .uv = {
+                _ripple_backend_unorm16((f32)x / RIPPLE_WGPU_ATLAS_SIZE),
+                _ripple_backend_unorm16((f32)y / RIPPLE_WGPU_ATLAS_SIZE),
+                _ripple_backend_unorm16((f32)(x + width) / RIPPLE_WGPU_ATLAS_SIZE),
+                _ripple_backend_unorm16((f32)(y + height) / RIPPLE_WGPU_ATLAS_SIZE)
+            },
+            .slot = slot,
+            .generation = _context.atlas.slots.items[slot].generation
+        };
+    }
 
-        _context.instance_buffer =
-            wgpuDeviceCreateBuffer(_context.config.device, &(WGPUBufferDescriptor) {
-                .size = _context.instance_buffer_size * sizeof(*_context.instances.items),
+    _RippleOwnedImage owned = { 0 };
+    owned.texture = wgpuDeviceCreateTexture(_context.config.device, &(WGPUTextureDescriptor){
+            .label = WEBGPU_STR("image"),
+            .size = (WGPUExtent3D){ .width = width, .height = height, .depthOrArrayLayers = 1 },
+            .format = WGPUTextureFormat_RGBA8Unorm,
+            .usage = WGPUTextureUsage_TextureBinding | WGPUTextureUsage_CopyDst,
+            .dimension = WGPUTextureDimension_2D,
+            .mipLevelCount = 1,
+            .sampleCount = 1
+        });
+    owned.view = wgpuTextureCreateView(owned.texture, &(WGPUTextureViewDescriptor){
+            .format = WGPUTextureFormat_RGBA8Unorm,
+            .dimension = WGPUTextureViewDimension_2D,
+            .mipLevelCount = 1,
+            .arrayLayerCount = 1,
+            .aspect = WGPUTextureAspect_All,
+        });
+    _ripple_backend_write_pixels(owned.texture, 0, 0, pixels, width, height, 4);
+    vektor_add(_context.owned_images, owned);
+    return ripple_wgpu_image(owned.view);
+}
+
+void ripple_wgpu_release_image(RippleImage image)
+{
+    if (image.view == _context.atlas.view)
+    {
+        // the whole atlas view, or a handle that was already released
+        if (!image.generation || image.slot >= _context.atlas.slots.n_items) return;
+        _RippleAtlasSlot* slot = &_context.atlas.slots.items[image.slot];
+        if (slot->generation != image.generation) return;
+        if (++slot->generation == 0) slot->generation = 1;
+        vektor_add(_context.atlas.free_slots, image.slot);
+
+        _RippleAtlasShelf* shelf = &_context.atlas.shelves.items[slot->shelf];
+        assert(shelf->n_images > 0);
+        if (--shelf->n_images == 0)
+        {
+            shelf->x = 0;
+            _ripple_backend_atlas_merge(slot->shelf);
+        }
+        return;
+    }
+
+    for (u32 i = 0; i < _context.bind_group_cache.n_items; i++)
+    {
+        _RippleBindGroupCacheEntry* entry = &_context.bind_group_cache.items[i];
+        for (u32 j = 0; j < array_len(entry->images); j++)
+        {
+            if (entry->images[j] != image.view) continue;
+            wgpuBindGroupRelease(entry->bind_group);
+            *entry = _context.bind_group_cache.items[--_context.bind_group_cache.n_items];
+            i--;
+            break;
+        }
+    }
+
+    for (u32 i = 0; i < _context.owned_images.n_items; i++)
+    {
+        _RippleOwnedImage* owned = &_context.owned_images.items[i];
+        if (owned->view != image.view) continue;
+        wgpuTextureViewRelease(owned->view);
+        wgpuTextureRelease(owned->texture);
+        *owned = _context.owned_images.items[--_context.owned_images.n_items];
+        break;
+    }
+}
+
+// the same panel drawn again finds its bind group here instead of creating one
+static WGPUBindGroup _ripple_backend_image_bind_group(WGPUTextureView images[5])
+{
+    _RippleBindGroupCacheEntry* least_recent = nullptr;
+    for (u32 i = 0; i < _context.bind_group_cache.n_items; i++)
+    {
+        _RippleBindGroupCacheEntry* entry = &_context.bind_group_cache.items[i];
+        bool same = true;
+        for (u32 j = 0; j < 5 && same; j++) same = entry->images[j] == images[j];
+        if (same)
+        {
+            entry->last_used = _context.frame;
+            return entry->bind_group;
+        }
+        if (!least_recent || entry->last_used < least_recent->last_used) least_recent = entry;
+    }
+
+    WGPUBindGroupEntry entries[5];
+    for (u32 j = 0; j < 5; j++)
+    {
+        entries[j] = (WGPUBindGroupEntry){ .binding = j, .textureView = images[j] };
+    }
+    WGPUBindGroup bind_group = wgpuDeviceCreateBindGroup(_context.config.device, &(WGPUBindGroupDescriptor)
+        {
+            .layout = _context.image_bind_group_layout,
+            .entryCount = array_len(entries),
+            .entries = entries
+        });
+    _context.stats.n_bind_groups_created++;
+
+    // ones used this frame are still referenced by the render pass being recorded
+    _RippleBindGroupCacheEntry entry = { .bind_group = bind_group, .last_used = _context.frame };
+    buf_copy(entry.images, images, sizeof(entry.images));
+    if (_context.bind_group_cache.n_items >= RIPPLE_WGPU_BIND_GROUP_CACHE_SIZE && least_recent->last_used != _context.frame)
+    {
+        wgpuBindGroupRelease(least_recent->bind_group);
+        *least_recent = entry;
+    }
+    else
+    {
+        vektor_add(_context.bind_group_cache, entry);
+    }
+
+    return bind_group;
+}
+
+static bool _ripple_backend_ring_in_flight(u64 offset, u64 size)
+{
+    for (u32 i = 0; i < RIPPLE_WGPU_FRAMES_IN_FLIGHT; i++)
+    {
+        u64 frame_offset = _context.ring.frames[i].offset;
+        u64 frame_size = _context.ring.frames[i].size;
+        if (frame_size && offset < frame_offset + frame_size && frame_offset < offset + size) return true;
+    }
+    return false;
+}
+
+// hands out this frame's slice of the ring, it only grows when the frames in flight leave no room
+static u64 _ripple_backend_ring_alloc(u64 size)
+{
+    size = (size + 255) & ~(u64)255;
+
+    // the slot being reused belongs to a frame the gpu is done with
+    u32 slot = _context.ring.frame++ % RIPPLE_WGPU_FRAMES_IN_FLIGHT;
+    _context.ring.frames[slot].size = 0;
+
+    u64 offset = _context.ring.head + size <= _context.ring.size ? _context.ring.head : 0;
+    if (offset + size > _context.ring.size || _ripple_backend_ring_in_flight(offset, size))
+    {
+        // queued frames keep the old buffer alive until they are done with it
+        if (_context.ring.buffer) wgpuBufferRelease(_context.ring.buffer);
+
+        _context.ring.size = max(max(_context.ring.size * 2, size * RIPPLE_WGPU_FRAMES_IN_FLIGHT), (u64)1 << 16);
+        _context.ring.buffer = wgpuDeviceCreateBuffer(_context.config.device, &(WGPUBufferDescriptor) {
+                .label = WEBGPU_STR("instance ring"),
+                .size = _context.ring.size,
                 .usage = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Vertex,
             });
+        buf_set(_context.ring.frames, 0, sizeof(_context.ring.frames));
+        offset = 0;
+
+        _context.stats.n_reallocations++;
+        _context.stats.size = _context.ring.size;
     }
 
-    wgpuQueueWriteBuffer(_context.config.queue,
-                         _context.instance_buffer,
-                         0,
-                         _context.instances.items,
-                         _context.instances.n_items * sizeof(*_context.instances.items));
+    _context.ring.frames[slot].offset = offset;
+    _context.ring.frames[slot].size = size;
+    _context.ring.head = offset + size;
+    return offset;
+}
 
+void ripple_backend_render_end(RippleRenderData render_data, RippleColor clear_color)
+{
+    unused clear_color; // ripple draws over whatever is already in the target, the pass loads it
+    u64 instance_bytes = _context.instances.n_items * sizeof(*_context.instances.items);
+    u64 instance_offset = 0;
+    if (instance_bytes)
+    {
+        instance_offset = _ripple_backend_ring_alloc(instance_bytes);
+        wgpuQueueWriteBuffer(_context.config.queue,
+                             _context.ring.buffer,
+                             instance_offset,
+                             _context.instances.items,
+                             instance_bytes);
+        _context.stats.n_uploads++;
+        _context.stats.uploaded_bytes += instance_bytes;
+    }
 
-    f32 clear_color_f32[4]; _ripple_backend_color_to_color(clear_color, clear_color_f32);
     WGPURenderPassEncoder render_pass = wgpuCommandEncoderBeginRenderPass(render_data.encoder, &(WGPURenderPassDescriptor){
             .colorAttachmentCount = 1,
             .colorAttachments = &(WGPURenderPassColorAttachment){
@@ -581,61 +1095,40 @@ void ripple_backend_render_end(RippleRenderData render_data, RippleColor clear_c
     wgpuRenderPassEncoderSetPipeline(render_pass, _context.pipeline);
     wgpuRenderPassEncoderSetBindGroup(render_pass, 0, _context.bind_group, 0, nullptr);
     wgpuRenderPassEncoderSetBindGroup(render_pass, 2, _context.sampler_bind_group, 0, nullptr);
+    if (instance_bytes)
+        wgpuRenderPassEncoderSetVertexBuffer(render_pass, 0, _context.ring.buffer, instance_offset, instance_bytes);
 
-    WGPUBindGroup bind_groups[_context.images.n_items];
-
-    u32 instance_index = 0;
     for (u32 i = 0; i < _context.images.n_items; i++)
     {
         _RippleImageInstancePair* image_pair = &_context.images.items[i];
-        WGPUBindGroupEntry image_textures[array_len(image_pair->images)];
+        u32 first_instance = image_pair->instance_index;
+        u32 end_instance = i + 1 < _context.images.n_items ? _context.images.items[i + 1].instance_index : _context.instances.n_items;
+        if (end_instance == first_instance) continue;
+
+        WGPUTextureView images[array_len(image_pair->images)];
         for (u32 j = 0; j < array_len(image_pair->images); j++)
         {
-            image_textures[j] = (WGPUBindGroupEntry){
-                .binding = j,
-                .textureView = image_pair->images[min(j, image_pair->n_images - 1)]
-            };
+            images[j] = image_pair->images[min(j, image_pair->n_images - 1)];
         }
 
-        bind_groups[i] = wgpuDeviceCreateBindGroup(_context.config.device, &(WGPUBindGroupDescriptor)
-            {
-                .layout = _context.image_bind_group_layout,
-                .entryCount = array_len(image_textures),
-                .entries = image_textures
-            });
-
-        u32 n_instances = ((i == _context.images.n_items - 1) ? _context.instances.n_items : image_pair->instance_index) - instance_index;
-
-        wgpuRenderPassEncoderSetVertexBuffer(render_pass, 0, _context.instance_buffer, 0, n_instances * sizeof(RippleWGPUInstance));
-        wgpuRenderPassEncoderSetBindGroup(render_pass, 1, bind_groups[i], 0, nullptr);
-        wgpuRenderPassEncoderDraw(render_pass, 6, n_instances, 0, 0);
-
-        instance_index += n_instances;
+        wgpuRenderPassEncoderSetBindGroup(render_pass, 1, _ripple_backend_image_bind_group(images), 0, nullptr);
+        wgpuRenderPassEncoderDraw(render_pass, 6, end_instance - first_instance, 0, first_instance);
     }
 
     wgpuRenderPassEncoderEnd(render_pass);
     wgpuRenderPassEncoderRelease(render_pass);
-
-    for (u32 i = 0; i < array_len(bind_groups); i++)
-    {
-        wgpuBindGroupRelease(bind_groups[i]);
-    }
 }
 
 void ripple_backend_render_rect(i32 x, i32 y, i32 w, i32 h, RippleColor color1, RippleColor color2, RippleColor color3, RippleColor color4, f32 radius1, f32 radius2, f32 radius3, f32 radius4)
 {
-    RippleWGPUInstance instance = {
+    vektor_add(_context.instances, (RippleWGPUInstance){
         .pos = { (f32)x, (f32)y },
         .size = { (f32)w, (f32)h },
-        .uv = { 0.0f, 0.0f, 1.0f, 1.0f },
-        .radius = { radius1, radius2, radius3, radius4 },
-        .image_index = 0
-    };
-    _ripple_backend_color_to_color(color1, instance.color1);
-    _ripple_backend_color_to_color(color2, instance.color2);
-    _ripple_backend_color_to_color(color3, instance.color3);
-    _ripple_backend_color_to_color(color4, instance.color4);
-    vektor_add(_context.instances, instance);
+        .uv = { 0, 0, 0xffff, 0xffff },
+        .radius = { _ripple_backend_unorm16(radius1), _ripple_backend_unorm16(radius2), _ripple_backend_unorm16(radius3), _ripple_backend_unorm16(radius4) },
+        .colors = { _ripple_backend_color_to_color(color1), _ripple_backend_color_to_color(color2), _ripple_backend_color_to_color(color3), _ripple_backend_color_to_color(color4) },
+        .flags = 0
+    });
 }
 
 void ripple_backend_render_image(i32 x, i32 y, i32 w, i32 h, RippleImage image)
@@ -644,7 +1137,7 @@ void ripple_backend_render_image(i32 x, i32 y, i32 w, i32 h, RippleImage image)
     _RippleImageInstancePair* pair = &_context.images.items[_context.images.n_items - 1];
     for (u32 i = 0; i < pair->n_images; i++)
     {
-        if (pair->images[i] == image)
+        if (pair->images[i] == image.view)
         {
             image_index = i;
             break;
@@ -654,7 +1147,7 @@ void ripple_backend_render_image(i32 x, i32 y, i32 w, i32 h, RippleImage image)
     if (image_index >= pair->n_images && pair->n_images >= array_len(pair->images))
     {
         vektor_add(_context.images, (_RippleImageInstancePair) {
-            .images = { [0] = _context.white_pixel.view, [1] = _context.font.view, [2] = image },
+            .images = { [0] = _context.atlas.view, [1] = _context.font.view, [2] = image.view },
             .n_images = 3,
             .instance_index = _context.instances.n_items
         });
@@ -666,62 +1159,357 @@ void ripple_backend_render_image(i32 x, i32 y, i32 w, i32 h, RippleImage image)
         if (image_index >= pair->n_images)
         {
             image_index = pair->n_images;
-            pair->images[pair->n_images++] = image;
+            pair->images[pair->n_images++] = image.view;
         }
-
-        pair->instance_index = _context.instances.n_items;
     }
 
     vektor_add(_context.instances, (RippleWGPUInstance){
         .pos = { (f32)x, (f32)y },
-        .uv = { 0.0f, 0.0f, 1.0f, 1.0f },
-        .color1 = { 1.0f, 1.0f, 1.0f, 1.0f},
-        .color2 = { 1.0f, 1.0f, 1.0f, 1.0f},
-        .color3 = { 1.0f, 1.0f, 1.0f, 1.0f},
-        .color4 = { 1.0f, 1.0f, 1.0f, 1.0f},
+        .uv = { image.uv[0], image.uv[1], image.uv[2], image.uv[3] },
+        .colors = { U32_MAX, U32_MAX, U32_MAX, U32_MAX },
         .size = { (f32)w, (f32)h },
-        .image_index = image_index
+        .flags = image_index + 1
     });
 }
 
+// decodes the codepoint starting at *i and moves past it, malformed bytes come out as U+FFFD one at a time
+static u32 _ripple_backend_utf8_next(str text, usize* i)
+{
+    const u8* bytes = (const u8*)text.ptr;
+    u8 lead = bytes[(*i)++];
+    if (lead < 0x80) return lead;
+
+    u32 n_continuation = lead >= 0xf0 ? 3 : lead >= 0xe0 ? 2 : lead >= 0xc0 ? 1 : 0;
+    if (n_continuation == 0 || lead >= 0xf8 || *i + n_continuation > text.size) return 0xfffd;
+
+    u32 codepoint = lead & (0x3f >> n_continuation);
+    for (u32 j = 0; j < n_continuation; j++)
+    {
+        u8 byte = bytes[*i + j];
+        if ((byte & 0xc0) != 0x80) return 0xfffd;
+        codepoint = (codepoint << 6) | (byte & 0x3f);
+    }
+    *i += n_continuation;
+
+    static const u32 smallest[] = { 0, 0x80, 0x800, 0x10000 };
+    if (codepoint < smallest[n_continuation] || codepoint > 0x10ffff || (codepoint >= 0xd800 && codepoint < 0xe000)) return 0xfffd;
+    return codepoint;
+}
+
+static _RippleGlyph* _ripple_backend_glyph(u32 codepoint)
+{
+    u64 key = codepoint;
+    u32* found = mapa_get(_context.font.glyph_map, &key);
+    if (found) return &_context.font.glyphs.items[*found];
+
+    _RippleGlyph glyph = { .index = stbtt_FindGlyphIndex(&_context.font.info, (i32)codepoint), .shelf = U32_MAX };
+    i32 advance, left_side_bearing, x0, y0, x1, y1;
+    stbtt_GetGlyphHMetrics(&_context.font.info, glyph.index, &advance, &left_side_bearing);
+    stbtt_GetGlyphBitmapBox(&_context.font.info, glyph.index, _context.font.scale, _context.font.scale, &x0, &y0, &x1, &y1);
+    glyph.advance = (f32)advance * _context.font.scale;
+#ifdef RIPPLE_WGPU_SDF_FONT
+    // stbtt_GetGlyphSDF grows the box by the padding, empty glyphs stay empty
+    if (x1 > x0 && y1 > y0)
+    {
+        x0 -= RIPPLE_WGPU_SDF_PADDING; y0 -= RIPPLE_WGPU_SDF_PADDING;
+        x1 += RIPPLE_WGPU_SDF_PADDING; y1 += RIPPLE_WGPU_SDF_PADDING;
+    }
+#endif // RIPPLE_WGPU_SDF_FONT
+    glyph.x0 = (i16)x0;
+    glyph.y0 = (i16)y0;
+    glyph.w = (u16)min(x1 - x0, (i32)BITMAP_SIZE - 2);
+    glyph.h = (u16)min(y1 - y0, (i32)BITMAP_SIZE - 2);
+
+    u32 glyph_i = _context.font.glyphs.n_items;
+    vektor_add(_context.font.glyphs, glyph);
+    mapa_insert(_context.font.glyph_map, &key, glyph_i);
+    return &_context.font.glyphs.items[glyph_i];
+}
+
+static void _ripple_backend_evict_glyph_shelf(_RippleGlyphShelf* shelf)
+{
+    shelf->generation++;
+    shelf->x = 0;
+    _context.font.generation++;
+    _context.stats.n_glyphs_evicted++;
+}
+
+// an evicted shelf over twice the height it is taken for gives the rest to a new shelf, an entry merged away if there is one
+static _RippleGlyphShelf* _ripple_backend_split_glyph_shelf(_RippleGlyphShelf* shelf, u32 height)
+{
+    if (shelf->height <= height * 2) return shelf;
+
+    u32 shelf_i = (u32)(shelf - _context.font.shelves.items);
+    _RippleGlyphShelf rest = { .y = shelf->y + height, .height = shelf->height - height };
+    shelf->height = height;
+
+    u32 rest_i = 0;
+    while (rest_i < _context.font.shelves.n_items && _context.font.shelves.items[rest_i].height) rest_i++;
+    if (rest_i == _context.font.shelves.n_items) vektor_add(_context.font.shelves, rest);
+    else
+    {
+        rest.generation = _context.font.shelves.items[rest_i].generation;
+        _context.font.shelves.items[rest_i] = rest;
+    }
+    return &_context.font.shelves.items[shelf_i];
+}
+
+// the shelf directly below, nullptr at the bottom of the atlas
+static _RippleGlyphShelf* _ripple_backend_glyph_shelf_below(_RippleGlyphShelf* shelf)
+{
+    for (u32 i = 0; i < _context.font.shelves.n_items; i++)
+    {
+        _RippleGlyphShelf* below = &_context.font.shelves.items[i];
+        if (below->height && below->y == shelf->y + shelf->height) return below;
+    }
+    return nullptr;
+}
+
+// same shelf fit as the image atlas, except that a full atlas evicts its least recently used shelf.
+// when every shelf is too short, a run of neighbours not drawn this frame is evicted and merged into one
+static _RippleGlyphShelf* _ripple_backend_glyph_shelf(u32 width, u32 height)
+{
+    _RippleGlyphShelf* best = nullptr;
+    _RippleGlyphShelf* least_recent = nullptr;
+    for (u32 i = 0; i < _context.font.shelves.n_items; i++)
+    {
+        _RippleGlyphShelf* shelf = &_context.font.shelves.items[i];
+        if (shelf->height < height) continue;
+        // glyphs drawn this frame are already in the instances
+        if (shelf->last_used != _context.frame && (!least_recent || shelf->last_used < least_recent->last_used)) least_recent = shelf;
+        if (shelf->height > height * 2 || shelf->x + width > BITMAP_SIZE) continue;
+        if (!best || shelf->height < best->height) best = shelf;
+    }
+    if (best) return best;
+
+    if (_context.font.height + height <= BITMAP_SIZE)
+    {
+        vektor_add(_context.font.shelves, (_RippleGlyphShelf){ .y = _context.font.height, .height = height });
+        _context.font.height += height;
+        return &_context.font.shelves.items[_context.font.shelves.n_items - 1];
+    }
+
+    if (least_recent)
+    {
+        _ripple_backend_evict_glyph_shelf(least_recent);
+        return _ripple_backend_split_glyph_shelf(least_recent, height);
+    }
+
+    // the run whose most recently used shelf is the oldest
+    _RippleGlyphShelf* first = nullptr;
+    u32 first_last_used = 0;
+    for (u32 i = 0; i < _context.font.shelves.n_items; i++)
+    {
+        _RippleGlyphShelf* shelf = &_context.font.shelves.items[i];
+        u32 run_height = 0, last_used = 0;
+        for (_RippleGlyphShelf* next = shelf; next && next->height && next->last_used != _context.frame && run_height < height; next = _ripple_backend_glyph_shelf_below(next))
+        {
+            run_height += next->height;
+            last_used = max(last_used, next->last_used);
+        }
+        if (run_height < height) continue;
+        if (!first || last_used < first_last_used)
+        {
+            first = shelf;
+            first_last_used = last_used;
+        }
+    }
+    if (!first) return nullptr;
+
+    // the merged shelves keep their entries with height 0, indices of the others stay put
+    _ripple_backend_evict_glyph_shelf(first);
+    while (first->height < height)
+    {
+        _RippleGlyphShelf* below = _ripple_backend_glyph_shelf_below(first);
+        _ripple_backend_evict_glyph_shelf(below);
+        first->height += below->height;
+        below->height = 0;
+    }
+    return _ripple_backend_split_glyph_shelf(first, height);
+}
+
+// rasterizes the glyph into the atlas if it isn't there yet, uploading only its own padded rectangle
+static bool _ripple_backend_glyph_resident(_RippleGlyph* glyph)
+{
+    if (glyph->shelf == U32_MAX || _context.font.shelves.items[glyph->shelf].generation != glyph->shelf_generation)
+    {
+        // a cleared border of one texel all around keeps whatever an evicted shelf left behind from bleeding in under linear filtering
+        u32 padded_w = glyph->w + 2u, padded_h = glyph->h + 2u;
+        if (padded_w * padded_h > _context.font.bitmap_size) return false;
+
+        _RippleGlyphShelf* shelf = _ripple_backend_glyph_shelf(padded_w, padded_h);
+        if (!shelf) return false;
+
+        glyph->shelf = (u32)(shelf - _context.font.shelves.items);
+        glyph->shelf_generation = shelf->generation;
+        glyph->x = (u16)(shelf->x + 1u);
+        glyph->y = (u16)(shelf->y + 1u);
+        shelf->x += padded_w;
+
+        u8* padded = _context.font.bitmap;
+        memset(padded, 0, padded_w * padded_h);
+#ifdef RIPPLE_WGPU_SDF_FONT
+        i32 w, h, x0, y0;
+        u8* sdf = stbtt_GetGlyphSDF(&_context.font.info, _context.font.scale, glyph->index, RIPPLE_WGPU_SDF_PADDING, 128, RIPPLE_WGPU_SDF_SCALE, &w, &h, &x0, &y0);
+        if (sdf)
+        {
+            u32 copy_w = min((u32)w, (u32)glyph->w), copy_h = min((u32)h, (u32)glyph->h);
+            for (u32 row = 0; row < copy_h; row++)
+                memcpy(&padded[(row + 1u) * padded_w + 1u], &sdf[row * (u32)w], copy_w);
+            stbtt_FreeSDF(sdf, nullptr);
+        }
+#else
+        stbtt_MakeGlyphBitmap(&_context.font.info, &padded[padded_w + 1u], glyph->w, glyph->h, (i32)padded_w, _context.font.scale, _context.font.scale, glyph->index);
+#endif // RIPPLE_WGPU_SDF_FONT
+        _ripple_backend_write_pixels(_context.font.texture, glyph->x - 1u, glyph->y - 1u, padded, padded_w, padded_h, 1);
+        _context.stats.n_glyphs_rasterized++;
+    }
+
+    _context.font.shelves.items[glyph->shelf].last_used = _context.frame;
+    return true;
+}
+
 void ripple_measure_text(str text, f32 font_size, i32* out_w, i32* out_h)
 {
     f32 scale = font_size / FONT_SIZE;
-    f32 x = 0.0f, y = 0.0f;
+    f32 x = 0.0f;
 
-    slice_for_each(text, c, char)
+    for (usize i = 0; i < text.size;)
     {
-        if (*c < 32) continue;
-        stbtt_GetBakedQuad(_context.font.glyphs, BITMAP_SIZE, BITMAP_SIZE, *c - 32, &x, &y, &(stbtt_aligned_quad){ 0 }, 1);
+        u8 byte = (u8)text.ptr[i];
+        if (byte < 0x80)
+        {
+            x += _context.font.ascii_advances[byte];
+            i++;
+            continue;
+        }
+        x += _ripple_backend_glyph(_ripple_backend_utf8_next(text, &i))->advance;
     }
 
     if (out_w) *out_w = (i32)(x * scale);
     if (out_h) *out_h = (i32)(font_size);
 }
 
-void ripple_backend_render_text(i32 pos_x, i32 pos_y, str text, f32 font_size, RippleColor color)
+// lays the string out glyph by glyph at the end of the current pool, rasterizing whatever isn't in the atlas.
+// returns false if the run can't be cached, a glyph didn't fit the atlas or a shelf has no bit
+static bool _ripple_backend_build_glyph_run(str text, f32 font_size, u32 packed_color, _RippleGlyphRun* out_run)
 {
+    typeof(_context.glyph_runs.pools[0])* pool = &_context.glyph_runs.pools[_context.glyph_runs.pool];
     f32 scale = font_size / FONT_SIZE;
-    f32 color_arr[4]; _ripple_backend_color_to_color(color, color_arr);
-    pos_y += font_size * 0.75f;
+    bool cacheable = true;
+    *out_run = (_RippleGlyphRun){ .first = pool->n_items };
+
     f32 x = 0.0f;
-    f32 y = 0.0f;
-    slice_for_each(text, c, char)
-    {
-        stbtt_aligned_quad quad;
-        stbtt_GetBakedQuad(_context.font.glyphs, BITMAP_SIZE, BITMAP_SIZE, *c - 32, &x, &y, &quad, 1);
-
-        vektor_add(_context.instances, (RippleWGPUInstance){
-            .pos = { pos_x + quad.x0 * scale, pos_y + quad.y0 * scale },
-            .size = { (quad.x1 - quad.x0) * scale, (quad.y1 - quad.y0) * scale },
-            .uv = { quad.s0, quad.t0, quad.s1, quad.t1 },
-            .color1 = { color_arr[0], color_arr[1], color_arr[2], color_arr[3] },
-            .color2 = { color_arr[0], color_arr[1], color_arr[2], color_arr[3] },
-            .color3 = { color_arr[0], color_arr[1], color_arr[2], color_arr[3] },
-            .color4 = { color_arr[0], color_arr[1], color_arr[2], color_arr[3] },
-            .image_index = 1
-        });
+    for (usize i = 0; i < text.size;)
+    {
+        u32 codepoint = _ripple_backend_utf8_next(text, &i);
+        if (codepoint < 32) continue;
+
+        _RippleGlyph* glyph = _ripple_backend_glyph(codepoint);
+        if (glyph->w && glyph->h)
+        {
+            if (!_ripple_backend_glyph_resident(glyph))
+            {
+                cacheable = false;
+            }
+            else
+            {
+                if (glyph->shelf < 64) out_run->shelves |= (u64)1 << glyph->shelf;
+                else cacheable = false;
+
+                f32 x0 = floorf(x + glyph->x0 + 0.5f);
+                vektor_add(*pool, (RippleWGPUInstance){
+                    .pos = { x0 * scale, glyph->y0 * scale },
+                    .size = { glyph->w * scale, glyph->h * scale },
+                    .uv = {
+                        _ripple_backend_unorm16((f32)glyph->x / BITMAP_SIZE),
+                        _ripple_backend_unorm16((f32)glyph->y / BITMAP_SIZE),
+                        _ripple_backend_unorm16((f32)(glyph->x + glyph->w) / BITMAP_SIZE),
+                        _ripple_backend_unorm16((f32)(glyph->y + glyph->h) / BITMAP_SIZE)
+                    },
+                    .colors = { packed_color, packed_color, packed_color, packed_color },
+                    .flags = 2
+                });
+            }
+        }
+        x += glyph->advance;
+    }
+
+    // glyphs of this frame are never evicted, so the run is good for whatever generation it ends up in
+    out_run->n_instances = pool->n_items - out_run->first;
+    out_run->generation = _context.font.generation;
+    _context.stats.n_glyph_runs_built++;
+    return cacheable;
+}
+
+void ripple_backend_render_text(i32 pos_x, i32 pos_y, str text, f32 font_size, RippleColor color)
+{
+    u32 packed_color = _ripple_backend_color_to_color(color);
+    pos_y += font_size * 0.75f;
+
+    u64 key = hash_combine(_ripple_hash_text(text, font_size), packed_color);
+    _RippleGlyphRun* run = mapa_get(_context.glyph_runs.map, &key);
+    _RippleGlyphRun uncached = { 0 };
+    typeof(_context.glyph_runs.texts[0])* texts = &_context.glyph_runs.texts[_context.glyph_runs.pool];
+    bool cached = run && run->generation == _context.font.generation &&
+        run->font_size == font_size && run->text_size == text.size && (!text.size || memcmp(texts->items + run->text_first, text.ptr, text.size) == 0);
+    if (cached)
+    {
+        for (u64 shelves = run->shelves; shelves; shelves &= shelves - 1)
+        {
+            _context.font.shelves.items[_ripple_backend_ctz64(shelves)].last_used = _context.frame;
+        }
     }
+    else
+    {
+        _RippleGlyphRun built;
+        cached = _ripple_backend_build_glyph_run(text, font_size, packed_color, &built);
+        if (run)
+        {
+            _context.glyph_runs.n_live -= run->n_instances;
+            _context.glyph_runs.n_live_text -= run->text_size;
+            mapa_remove(_context.glyph_runs.map, &key);
+        }
+        if (cached)
+        {
+            built.text_first = texts->n_items;
+            built.text_size = (u32)text.size;
+            built.font_size = font_size;
+            if (text.size)
+            {
+                _ripple_vektor_reserve(*texts, text.size);
+                buf_copy(texts->items + texts->n_items, text.ptr, text.size);
+                texts->n_items += text.size;
+            }
+
+            run = mapa_insert(_context.glyph_runs.map, &key, built);
+            _context.glyph_runs.n_live += built.n_instances;
+            _context.glyph_runs.n_live_text += built.text_size;
+        }
+        else
+        {
+            uncached = built;
+            run = &uncached;
+        }
+    }
+    run->last_used = _context.frame;
+
+    typeof(_context.glyph_runs.pools[0])* pool = &_context.glyph_runs.pools[_context.glyph_runs.pool];
+    if (run->n_instances)
+    {
+        _ripple_vektor_reserve(_context.instances, run->n_instances);
+        RippleWGPUInstance* instances = _context.instances.items + _context.instances.n_items;
+        buf_copy(instances, pool->items + run->first, run->n_instances * sizeof(*instances));
+        for (u32 i = 0; i < run->n_instances; i++)
+        {
+            instances[i].pos[0] += pos_x;
+            instances[i].pos[1] += pos_y;
+        }
+        _context.instances.n_items += run->n_instances;
+    }
+
+    // drawn once and forgotten
+    if (!cached) pool->n_items = run->first;
 }
 
 #endif // RIPPLE_WGPU_IMPLEMENTATION
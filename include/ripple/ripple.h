@@ -3,6 +3,12 @@
 
 // for offsetof
 #include <stddef.h>
+// for frame stats timing
+#include <time.h>
+// for qsort and malloc
+#include <stdlib.h>
+// for memcpy and memcmp
+#include <string.h>
 
 #include <printccy/printccy.h>
 #include <marrow/marrow.h>
@@ -106,7 +112,6 @@ STRUCT(RippleElementConfig) {
 
 STRUCT(RippleElementState) {
     struct {
-        u8 _frame_color : 1;
         u8 clicked : 1; // left click pressed and hovered
         u8 released : 1; // left click released and hovered
         u8 hovered : 1; // as long as cursor is in bounds
@@ -119,31 +124,133 @@ STRUCT(RippleElementState) {
 STRUCT(ElementState) {
     RenderedLayout layout;
     RippleElementState state;
+    u32 element; // index of the element that used this state in the current frame
     union {
         u64 user_data;
         void* user_ptr;
     };
 };
 
-STRUCT(ElementData) {
-    u64 id;
-    RippleElementConfig config;
-    RenderedLayout calculated_layout;
+// elements are split into parallel arrays so layout passes only pull in the bytes they use
 
+STRUCT(ElementNode) {
+    u64 id;
     u32 parent_element;
     u32 n_children;
     u32 last_child;
     u32 next_sibling;
-    u32 prev_sibling; // equals parent index if first sibling
+    u32 first_child_index; // into child_indices, written when the element is popped
+    struct { i32 w, h; } children_bounds; // accumulated by children as they are popped
+    bool wrapped_text; // submitted with WRAPPED_WORDS, its height follows its width
+    bool wrapped_children; // set once a child with wrapped_text is linked
+
+    u64 layout_hash; // of the layout configs and shape of the whole subtree, complete once popped
+    u32 subtree_size; // including the element itself
+    u32 prev_index; // same element in prev_elements, U32_MAX if there is none
+};
+
+// generation 0 is never handed out, so a zeroed handle means no state
+STRUCT(RippleStateHandle) {
+    u32 slot;
+    u32 generation;
+};
+
+STRUCT(ElementRender) {
+    render_func_t* render_func;
+    void* render_data;
+    u32 render_data_size;
+    u8 layer;
+    RippleStateHandle state; // set once the element uses STATE() and friends
+};
+
+#define RIPPLE_STATE_PAGE_SIZE 256
+
+typedef void (state_destructor_t)(void* data);
 
-    bool update_state;
+STRUCT(RippleStateSlot) {
+    ElementState state;
+    u64 id;
+    u32 generation; // bumped when the slot is freed, so handles to the old state stop resolving
+    u32 last_frame; // elements_states.frame of the last frame the state was used in
+};
+
+// kept apart from the slots so the per frame passes over them stay small
+STRUCT(RippleStateAlloc) {
+    void* data; // from STATE_ALLOC, freed together with the state
+    state_destructor_t* destructor;
+    u32 size;
+};
+
+#define RIPPLE_STATE_ARENA_BLOCK_SIZE (64 * 1024)
+#define RIPPLE_STATE_ARENA_N_CLASSES 8 // 16 bytes up to 2 kilobytes, anything bigger goes straight to malloc
+
+// STATE_ALLOC memory, carved from big blocks in power of two size classes so freed allocations can be reused
+STRUCT(RippleStateArena) {
+    VEKTOR(u8*) blocks;
+    u8* cursor;
+    usize remaining; // in the current block
+    void* free_lists[RIPPLE_STATE_ARENA_N_CLASSES]; // linked through the first bytes of every freed allocation
+};
+
+// a range of elements recorded by RIPPLE_MEMO, element and child indices are relative to its first element
+STRUCT(RippleMemo) {
+    u64 deps_hash;
+    u32 first_element; // into the active memo pool
+    u32 n_elements;
+    u32 first_child_index;
+    u32 n_child_indices;
+    u64 wrap_hash; // of the widths its wrapped text was broken at while popping, 0 if there is none
+    u8 _frame_color;
+};
+
+#define RIPPLE_MEMO_BLOCK_SIZE (64 * 1024)
+
+// render data copied into a memo pool, carved from blocks of the elements allocator. a reset keeps the blocks for reuse
+STRUCT(RippleMemoRenderData) {
+    VEKTOR(u8*) blocks;
+    VEKTOR(u8*) large; // copies bigger than a block, freed on reset
+    u32 block; // being carved, blocks.n_items before the first copy
+    usize used; // of it
+};
+
+STRUCT(RippleMemoPool) {
+    VEKTOR(ElementNode) nodes; // U32_MAX in parent_element means the element the memo is in
+    VEKTOR(RippleElementLayoutConfig) configs;
+    VEKTOR(RenderedLayout) layouts; // as they were when popped
+    VEKTOR(ElementRender) renders; // render data points into render_data
+    VEKTOR(u32) child_indices;
+    RippleMemoRenderData render_data;
 };
 
 STRUCT(RippleWindow) {
     RippleCursorState cursor_state;
     RippleCursorState prev_cursor_state;
-    VEKTOR(ElementData) elements;
-    MAPA(u64, ElementState) elements_states;
+    struct {
+        VEKTOR(ElementNode) nodes; // tree links
+        VEKTOR(RippleElementLayoutConfig) configs;
+        VEKTOR(RenderedLayout) layouts; // calculated layouts
+        VEKTOR(ElementRender) renders;
+        VEKTOR(u32) child_indices; // the children of every element are stored contiguously here
+    } elements, prev_elements; // indexed by element, in push order. prev_elements keeps the tree, layout configs, layouts and state handles of the last frame
+    VEKTOR(u32) sorted_elements; // by layer, then in push order. filled by ripple_submit only when more than one layer is used, push order is sorted otherwise
+    VEKTOR(u32) stateful_elements; // that used their state this frame, in push order. only these can be hovered
+    u32 layer_starts[257]; // the elements on layer l are sorted_elements[layer_starts[l]] up to sorted_elements[layer_starts[l + 1]]
+    struct {
+        VEKTOR(RippleStateSlot*) pages; // slots are allocated a page at a time and never move, so states keep their address while alive
+        VEKTOR(RippleStateAlloc*) alloc_pages; // same layout as pages
+        u32 n_slots;
+        VEKTOR(u32) free_slots;
+        MAPA(u64, u32) slots; // element id -> slot
+        VEKTOR(u32) touched, prev_touched; // slots used this frame and the last one
+        u32 frame;
+        RippleStateArena arena;
+    } elements_states;
+    MAPA(u64, RippleMemo) memos;
+    RippleMemoPool memo_pools[2]; // memos are recorded into memo_pools[memo_pool], the other one is only used to compact it
+    u32 memo_pool;
+    VEKTOR(struct { u64 key; u64 deps_hash; u32 first_element; u32 first_child_index; }) open_memos; // whose body is running
+    VEKTOR(i32) grow_starts; // scratch for element_grow_children
+    VEKTOR(i32) grow_ends;
     void* user_data;
     struct {
         u64 id;
@@ -154,11 +261,117 @@ STRUCT(RippleWindow) {
     u32 current_layer;
 };
 
+// filled by ripple_submit when collect_stats is set, times are in nanoseconds
+STRUCT(RippleFrameStats) {
+    u64 layout_ns; // finalize_element over the whole tree
+    u64 state_sweep_ns; // update_element_state on every live state, removing dead ones
+    u64 sort_ns; // sorting elements by layer
+    u64 update_ns; // finding the topmost element under the cursor
+    u64 render_ns; // every render_func
+    u64 render_end_ns; // ripple_backend_render_end
+    u64 total_ns;
+
+    u32 n_elements;
+    u32 n_reused_layouts; // elements whose layout was copied from the previous frame
+    u32 n_replayed_elements; // elements RIPPLE_MEMO replayed instead of running its body
+    u32 n_states;
+    u32 n_state_hits; // STATE() calls that found their state where the element was last frame
+    u32 n_state_misses; // and the ones that had to look it up by id
+    u32 n_text_measures; // ripple_text_size calls that missed the cache and measured
+    u32 n_line_breaks; // ripple_text_lines calls that missed the cache and broke the text
+    u32 n_instances;
+};
+
+// where ripple keeps its memory, nullptr uses the default heap.
+// everything but frame is persistent and reused, after the first few frames their capacity covers the biggest frame so far
+STRUCT(RippleAllocatorConfig) {
+    Allocator* elements; // element arrays, sorting and memo pools
+    Allocator* states; // element states, their id map and STATE_ALLOC memory
+    Allocator* backend; // backend instance and image buffers
+    Allocator* frame; // render data copies, they are done with once ripple_submit returns. reset it after every ripple_submit
+};
+
+// ripple_text_size entries not asked for in this many frames are dropped, a power of two
+#ifndef RIPPLE_TEXT_CACHE_FRAMES
+#define RIPPLE_TEXT_CACHE_FRAMES 64
+#endif // RIPPLE_TEXT_CACHE_FRAMES
+
+STRUCT(RippleTextSize) {
+    i32 w, h;
+    u32 last_used; // frame
+};
+
+STRUCT(RippleTextLine) {
+    u32 start, size; // in bytes of the text
+};
+
+// a text broken into lines at some width
+STRUCT(RippleTextLines) {
+    u32 first_line, n_lines; // into the current line pool
+    i32 line_height;
+    u32 last_used; // frame
+};
+
+STRUCT(RippleWrapWidth) {
+    i32 width;
+    u32 last_used; // frame
+};
+
+STRUCT(RippleTextConfig) {
+    RippleColor color;
+    str text;
+};
+
+STRUCT(RippleWrappedTextConfig) {
+    RippleColor color;
+    str text;
+    f32 font_size;
+};
+
+// keys text caches here and in the backends
+static inline u64 _ripple_hash_text(str text, f32 font_size)
+{
+    u32 size_bits; buf_copy(&size_bits, &font_size, sizeof(size_bits));
+    u64 hash = hash_u64((u64)text.size << 32 | size_bits);
+    usize i = 0;
+    for (; i + sizeof(u64) <= text.size; i += sizeof(u64))
+    {
+        u64 word; buf_copy(&word, text.ptr + i, sizeof(word));
+        hash = hash_combine(hash, hash_u64(word));
+    }
+    u64 tail = 0;
+    if (i < text.size) buf_copy(&tail, text.ptr + i, text.size - i);
+    return hash_combine(hash, hash_u64(tail));
+}
+
+// grows v to hold n more items without adding them, so they can be written in one go instead of a vektor_add each.
+// goes through vektor_add's own growth, which only happens when the vektor is full
+#define _ripple_vektor_reserve(v, n) do {\
+    u32 _n_items = (v).n_items;\
+    while ((v).size < _n_items + (n)) { (v).n_items = (v).size; vektor_add(v, (typeof(*(v).items)){ 0 }); }\
+    (v).n_items = _n_items;\
+} while (0)
+
 STRUCT(RippleContext) {
     bool initialized;
-    BumpAllocator frame_allocator;
+    RippleAllocatorConfig allocators;
+    BumpAllocator frame_allocator; // used when allocators.frame is nullptr
     u32 frame_color;
     RippleWindow current_window;
+    u32 n_replayed_elements;
+    u32 n_state_hits, n_state_misses;
+    u32 frame;
+    MAPA(u64, RippleTextSize) text_sizes; // hash of the text and font size -> its size
+    u32 n_text_measures;
+    MAPA(u64, RippleTextLines) text_lines; // hash of the text, font size and width -> where it breaks
+    VEKTOR(RippleTextLine) line_pools[2]; // lines are added to line_pools[line_pool], the other one is only used to compact it
+    u32 line_pool;
+    u32 n_live_lines; // in the current pool that belong to an entry of text_lines
+    MAPA(u64, RippleWrapWidth) wrap_widths; // element id -> the width its wrapped text had last frame
+    u32 n_line_breaks;
+
+    bool collect_stats;
+    RippleFrameStats stats;
 };
 
 #define RIPPLE_WGPU 1 << 0
@@ -193,8 +406,19 @@ void ripple_push_id(u64);
 void ripple_submit_element(RippleElementConfig config); // copies render data if its size is non zero
 void ripple_pop_id(void);
 
-RippleContext ripple_initialize(RippleBackendRendererConfig config);
+// used by RIPPLE_MEMO, begin returns false if the elements were replayed and the body should be skipped
+bool ripple_memo_begin(u64 id, u64 deps_hash);
+void ripple_memo_end(void);
+
+RippleContext ripple_initialize(RippleBackendRendererConfig renderer_config, RippleAllocatorConfig allocators);
 void ripple_make_active_context(RippleContext* context);
+Allocator* ripple_frame_allocator(void); // of the active context, everything from it lives until ripple_submit returns
+void ripple_text_size(str text, f32 font_size, i32* out_w, i32* out_h); // ripple_measure_text, cached in the active context
+// text broken into lines no wider than width, splitting at spaces and newlines. a word wider than width gets a line of its own.
+// cached in the active context, out_lines stays valid until the next call and may be nullptr
+u32 ripple_text_lines(str text, f32 font_size, i32 width, RippleTextLine** out_lines, i32* out_line_height);
+render_func_t render_text; // WORDS
+render_func_t render_wrapped_text; // WRAPPED_WORDS
 void ripple_submit(RippleContext* context, u32 width, u32 height, RippleRenderData render_data);
 
 #ifdef RIPPLE_IMPLEMENTATION
@@ -232,26 +456,95 @@ void ripple_on_mouse_event(RippleContext* context, RippleMouseEvent evt)
     }
 }
 
+static void _ripple_add_element(RippleWindow* window, ElementNode node)
+{
+    vektor_add(window->elements.nodes, node);
+    vektor_add(window->elements.configs, (RippleElementLayoutConfig){ 0 });
+    vektor_add(window->elements.layouts, (RenderedLayout){ 0 });
+    vektor_add(window->elements.renders, (ElementRender){ 0 });
+}
+
 void ripple_reset(RippleContext* context)
 {
-    vektor_clear(context->current_window.elements);
-    vektor_add(context->current_window.elements, (ElementData) { 0 });
+    // keep this frame's tree and layouts around so unchanged subtrees can reuse them
+    #define SWAP(a, b) do { typeof(a) tmp = (a); (a) = (b); (b) = tmp; } while(0)
+    SWAP(context->current_window.elements.nodes, context->current_window.prev_elements.nodes);
+    SWAP(context->current_window.elements.configs, context->current_window.prev_elements.configs);
+    SWAP(context->current_window.elements.layouts, context->current_window.prev_elements.layouts);
+    SWAP(context->current_window.elements.renders, context->current_window.prev_elements.renders);
+    SWAP(context->current_window.elements.child_indices, context->current_window.prev_elements.child_indices);
+    #undef SWAP
+
+    vektor_clear(context->current_window.elements.nodes);
+    vektor_clear(context->current_window.elements.configs);
+    vektor_clear(context->current_window.elements.layouts);
+    vektor_clear(context->current_window.elements.renders);
+    vektor_clear(context->current_window.elements.child_indices);
+    vektor_clear(context->current_window.stateful_elements);
+    _ripple_add_element(&context->current_window, (ElementNode){ 0 });
+
+    vektor_clear(context->current_window.open_memos);
+    context->n_replayed_elements = 0;
+    context->n_state_hits = 0;
+    context->n_state_misses = 0;
+    context->n_text_measures = 0;
+    context->n_line_breaks = 0;
 
     context->current_window.current_element.id = 0;
     context->current_window.current_element.index = 0;
 
-    bump_allocator_reset(&context->frame_allocator);
+    if (!context->allocators.frame)
+        bump_allocator_reset(&context->frame_allocator);
 }
 
-RippleContext ripple_initialize(RippleBackendRendererConfig renderer_config)
+RippleContext ripple_initialize(RippleBackendRendererConfig renderer_config, RippleAllocatorConfig allocators)
 {
-    RippleContext context = { .initialized = true };
-    context.frame_allocator = bump_allocator_create();
-    ripple_backend_renderer_initialize(renderer_config);
-
-    // TODO: use allocators here lol
-    vektor_init(context.current_window.elements, 0, nullptr);
-    mapa_init(context.current_window.elements_states, mapa_hash_u64, mapa_cmp_bytes, nullptr);
+    RippleContext context = { .initialized = true, .allocators = allocators };
+    if (!allocators.frame)
+        context.frame_allocator = bump_allocator_create();
+    ripple_backend_renderer_initialize(renderer_config, allocators.backend);
+
+    Allocator* elements = allocators.elements;
+    Allocator* states = allocators.states;
+    vektor_init(context.current_window.elements.nodes, 0, elements);
+    vektor_init(context.current_window.elements.configs, 0, elements);
+    vektor_init(context.current_window.elements.layouts, 0, elements);
+    vektor_init(context.current_window.elements.renders, 0, elements);
+    vektor_init(context.current_window.elements.child_indices, 0, elements);
+    vektor_init(context.current_window.prev_elements.nodes, 0, elements);
+    vektor_init(context.current_window.prev_elements.configs, 0, elements);
+    vektor_init(context.current_window.prev_elements.layouts, 0, elements);
+    vektor_init(context.current_window.prev_elements.renders, 0, elements);
+    vektor_init(context.current_window.prev_elements.child_indices, 0, elements);
+    vektor_init(context.current_window.elements_states.pages, 0, states);
+    vektor_init(context.current_window.elements_states.alloc_pages, 0, states);
+    vektor_init(context.current_window.elements_states.free_slots, 0, states);
+    mapa_init(context.current_window.elements_states.slots, mapa_hash_u64, mapa_cmp_bytes, states);
+    vektor_init(context.current_window.elements_states.touched, 0, states);
+    vektor_init(context.current_window.elements_states.prev_touched, 0, states);
+    vektor_init(context.current_window.elements_states.arena.blocks, 0, states);
+    mapa_init(context.current_window.memos, mapa_hash_u64, mapa_cmp_bytes, elements);
+    mapa_init(context.text_sizes, mapa_hash_u64, mapa_cmp_bytes, elements);
+    mapa_init(context.text_lines, mapa_hash_u64, mapa_cmp_bytes, elements);
+    vektor_init(context.line_pools[0], 0, elements);
+    vektor_init(context.line_pools[1], 0, elements);
+    mapa_init(context.wrap_widths, mapa_hash_u64, mapa_cmp_bytes, elements);
+    for (u32 i = 0; i < array_len(context.current_window.memo_pools); i++)
+    {
+        RippleMemoPool* pool = &context.current_window.memo_pools[i];
+        vektor_init(pool->nodes, 0, elements);
+        vektor_init(pool->configs, 0, elements);
+        vektor_init(pool->layouts, 0, elements);
+        vektor_init(pool->renders, 0, elements);
+        vektor_init(pool->child_indices, 0, elements);
+        vektor_init(pool->render_data.blocks, 0, elements);
+        vektor_init(pool->render_data.large, 0, elements);
+    }
+    vektor_init(context.current_window.open_memos, 0, elements);
+    vektor_init(context.current_window.sorted_elements, 0, elements);
+    vektor_init(context.current_window.stateful_elements, 0, elements);
+    vektor_init(context.current_window.grow_starts, 0, elements);
+    vektor_init(context.current_window.grow_ends, 0, elements);
 
     ripple_reset(&context);
 
@@ -263,12 +556,126 @@ void ripple_make_active_context(RippleContext* context)
     _ripple_context = context;
 }
 
-static void finalize_element(ElementData* element);
-static void update_element_state(ElementState* state);
+Allocator* ripple_frame_allocator(void)
+{
+    return _ripple_context->allocators.frame ? _ripple_context->allocators.frame : (Allocator*)&_ripple_context->frame_allocator;
+}
+
+void ripple_text_size(str text, f32 font_size, i32* out_w, i32* out_h)
+{
+    RippleContext* context = _ripple_context;
+    u64 key = _ripple_hash_text(text, font_size);
+    RippleTextSize* size = mapa_get(context->text_sizes, &key);
+    if (!size)
+    {
+        RippleTextSize measured = { 0 };
+        ripple_measure_text(text, font_size, &measured.w, &measured.h);
+        size = mapa_insert(context->text_sizes, &key, measured);
+        context->n_text_measures++;
+    }
+    size->last_used = context->frame;
+
+    if (out_w) *out_w = size->w;
+    if (out_h) *out_h = size->h;
+}
+
+// greedy, every line takes words while it still fits
+static void _ripple_break_text(typeof(_ripple_context->line_pools[0])* lines, str text, f32 font_size, i32 width)
+{
+    for (usize paragraph = 0; paragraph <= text.size;)
+    {
+        usize paragraph_end = paragraph;
+        while (paragraph_end < text.size && text.ptr[paragraph_end] != '\n') paragraph_end++;
+
+        usize line_start = paragraph, line_end = paragraph;
+        for (usize i = paragraph; i < paragraph_end;)
+        {
+            usize word_start = i;
+            while (word_start < paragraph_end && text.ptr[word_start] == ' ') word_start++;
+            usize word_end = word_start;
+            while (word_end < paragraph_end && text.ptr[word_end] != ' ') word_end++;
+            if (word_start == word_end) break;
+
+            // measured as a whole, summing the words would round differently than drawing the line
+            i32 w, h; ripple_measure_text((str){ .ptr = text.ptr + line_start, .size = word_end - line_start }, font_size, &w, &h);
+            if (w <= width || line_end == line_start)
+            {
+                line_end = i = word_end;
+                continue;
+            }
+
+            vektor_add(*lines, (RippleTextLine){ (u32)line_start, (u32)(line_end - line_start) });
+            line_start = line_end = i = word_start;
+        }
+        vektor_add(*lines, (RippleTextLine){ (u32)line_start, (u32)(line_end - line_start) });
+
+        paragraph = paragraph_end + 1;
+    }
+}
+
+u32 ripple_text_lines(str text, f32 font_size, i32 width, RippleTextLine** out_lines, i32* out_line_height)
+{
+    RippleContext* context = _ripple_context;
+    u64 key = hash_combine(_ripple_hash_text(text, font_size), hash_u64((u32)width));
+    RippleTextLines* lines = mapa_get(context->text_lines, &key);
+    typeof(context->line_pools[0])* pool = &context->line_pools[context->line_pool];
+    if (!lines)
+    {
+        RippleTextLines broken = { .first_line = pool->n_items };
+        ripple_measure_text((str){ .ptr = text.ptr, .size = 0 }, font_size, &(i32){ 0 }, &broken.line_height);
+        _ripple_break_text(pool, text, font_size, width);
+        broken.n_lines = pool->n_items - broken.first_line;
+        lines = mapa_insert(context->text_lines, &key, broken);
+        context->n_live_lines += broken.n_lines;
+        context->n_line_breaks++;
+    }
+    lines->last_used = context->frame;
+
+    if (out_lines) *out_lines = &pool->items[lines->first_line];
+    if (out_line_height) *out_line_height = lines->line_height;
+    return lines->n_lines;
+}
+
+static u64 _ripple_time_ns(void)
+{
+    struct timespec ts;
+#ifdef CLOCK_MONOTONIC
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+    timespec_get(&ts, TIME_UTC);
+#endif
+    return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+// stores the time since the previous lap into stats.field
+#define _RIPPLE_STATS_LAP(field)\
+    if (context->collect_stats) {\
+        u64 now = _ripple_time_ns();\
+        context->stats.field = now - lap_time;\
+        lap_time = now;\
+    }
+
+static void gather_element_children(RippleWindow* window, u32 element);
+static void compact_memo_pool(RippleWindow* window);
+static bool element_reuse_layouts(u32 element);
+static void finalize_element(u32 element);
+static void update_element_state(ElementState* state, bool hovered);
+static RippleStateSlot* _ripple_state_slot(RippleWindow* window, u32 slot);
+static RippleStateSlot* _ripple_resolve_state(RippleWindow* window, RippleStateHandle handle);
+static void _ripple_touch_state(RippleWindow* window, u32 slot);
+static RippleStateAlloc* _ripple_state_alloc_of(RippleWindow* window, u32 slot);
+static void _ripple_free_state_alloc(RippleWindow* window, RippleStateAlloc* alloc);
+static void* _ripple_alloc(Allocator* allocator, usize size);
+static void _ripple_free(Allocator* allocator, void* data);
 void ripple_submit(RippleContext* context, u32 width, u32 height, RippleRenderData render_data)
 {
     RippleWindow* window = &context->current_window;
 
+    u64 start_time = context->collect_stats ? _ripple_time_ns() : 0;
+    u64 lap_time = start_time;
+
+    // keep_inside depends on the window size, so a resize invalidates every cached layout
+    bool reuse_layouts = window->prev_elements.nodes.n_items > 0 && window->width == width && window->height == height;
     window->width = width;
     window->height = height;
 
@@ -286,39 +693,188 @@ void ripple_submit(RippleContext* context, u32 width, u32 height, RippleRenderDa
 
     window->prev_cursor_state = *state;
 
-    window->elements.items[0].calculated_layout = (RenderedLayout){ .x = 0, .y = 0, .w = width, .h = height };
+    u32 n_elements = window->elements.nodes.n_items;
+    window->elements.layouts.items[0] = (RenderedLayout){ .x = 0, .y = 0, .w = width, .h = height };
+
+    // every other element does this when it is popped
+    gather_element_children(window, 0);
+    window->elements.nodes.items[0].subtree_size = n_elements;
+    window->elements.nodes.items[0].prev_index = reuse_layouts ? 0 : U32_MAX;
+
+    // elements are stored in the order they were pushed so every parent comes before its children
+    u32 n_reused_layouts = 0;
+    for (u32 i = 0; i < n_elements; i++)
+    {
+        if (element_reuse_layouts(i))
+        {
+            u32 subtree_size = window->elements.nodes.items[i].subtree_size;
+            n_reused_layouts += subtree_size;
+            i += subtree_size - 1;
+            continue;
+        }
+        finalize_element(i);
+    }
+
+    _RIPPLE_STATS_LAP(layout_ns);
+
+    // counting sort on the layer, it is stable so elements on the same layer stay in push order
+    ElementRender* renders = window->elements.renders.items;
+    u32 layer_counts[256] = { 0 };
+    for (u32 i = 0; i < n_elements; i++)
+        layer_counts[renders[i].layer]++;
 
-    finalize_element(&window->elements.items[0]);
+    for (u32 layer = 0, start = 0; layer < array_len(layer_counts); layer++)
+    {
+        window->layer_starts[layer] = start;
+        start += layer_counts[layer];
+    }
+    window->layer_starts[array_len(layer_counts)] = n_elements;
 
-    // remove dead elements
-    for (i32 element_i = 0; element_i < (i64)window->elements_states.size; element_i++)
+    // push order already is sorted if everything is on one layer, then sorted stays nullptr and element i is simply i
+    u32* sorted = nullptr;
+    if (layer_counts[renders[0].layer] != n_elements)
     {
-        ElementState* state = mapa_get_at_index(window->elements_states, (u64)element_i);
-        if(!state) continue;
+        vektor_clear(window->sorted_elements);
+        _ripple_vektor_reserve(window->sorted_elements, n_elements);
+        window->sorted_elements.n_items = n_elements;
+        sorted = window->sorted_elements.items;
+
+        u32 offsets[256];
+        memcpy(offsets, window->layer_starts, sizeof(offsets));
+        for (u32 i = 0; i < n_elements; i++)
+            sorted[offsets[renders[i].layer]++] = i;
+    }
 
-        if (state->state._frame_color != context->frame_color)
+    _RIPPLE_STATS_LAP(sort_ns);
+
+    // only elements that use their state can be hovered, so the cost does not grow with plain elements.
+    // the topmost one under the cursor wins, the highest layer and then the last pushed. on one layer that is the first hit from the back
+    u32 hovered_element = U32_MAX;
+    if (state->valid)
+    {
+        RenderedLayout* layouts = window->elements.layouts.items;
+        u32* stateful = window->stateful_elements.items;
+        u64 hovered_order = 0;
+        for (i32 i = (i32)window->stateful_elements.n_items - 1; i >= 0; i--)
         {
-            mapa_remove_at_index(window->elements_states, (u64)element_i);
-            element_i--;
+            u32 element = stateful[i];
+            RenderedLayout layout = layouts[element];
+            if (state->x < layout.x || state->x >= layout.x + layout.w || state->y < layout.y || state->y >= layout.y + layout.h)
+                continue;
+
+            u64 order = (u64)renders[element].layer << 32 | element;
+            if (hovered_element == U32_MAX || order > hovered_order)
+            {
+                hovered_element = element;
+                hovered_order = order;
+            }
+            if (!sorted) break;
+        }
+    }
+    state->consumed = hovered_element != U32_MAX;
+
+    _RIPPLE_STATS_LAP(update_ns);
+
+    // states used this frame are updated in place, of the ones used last frame those that were not used again are dead.
+    // neither loop looks at states that were already dead
+    typeof(window->elements_states)* states = &window->elements_states;
+    u32 n_states = states->touched.n_items;
+    for (u32 i = 0; i < states->touched.n_items; i++)
+    {
+        ElementState* element_state = &_ripple_state_slot(window, states->touched.items[i])->state;
+        element_state->layout = window->elements.layouts.items[element_state->element];
+        update_element_state(element_state, element_state->element == hovered_element);
+    }
+
+    for (u32 i = 0; i < states->prev_touched.n_items; i++)
+    {
+        RippleStateSlot* slot = _ripple_state_slot(window, states->prev_touched.items[i]);
+        if (slot->last_frame == states->frame) continue;
+
+        mapa_remove(states->slots, &slot->id);
+        RippleStateAlloc* alloc = _ripple_state_alloc_of(window, states->prev_touched.items[i]);
+        if (alloc->data) _ripple_free_state_alloc(window, alloc);
+        if (++slot->generation == 0) slot->generation = 1;
+        vektor_add(states->free_slots, states->prev_touched.items[i]);
+    }
+
+    typeof(states->touched) prev_touched = states->prev_touched;
+    states->prev_touched = states->touched;
+    states->touched = prev_touched;
+    vektor_clear(states->touched);
+    states->frame++;
+
+    u32 n_memo_elements = 0;
+    for (i32 memo_i = 0; memo_i < (i64)window->memos.size; memo_i++)
+    {
+        RippleMemo* memo = mapa_get_at_index(window->memos, (u64)memo_i);
+        if (!memo) continue;
+
+        if (memo->_frame_color != context->frame_color)
+        {
+            mapa_remove_at_index(window->memos, (u64)memo_i);
+            memo_i--;
             continue;
         }
+        n_memo_elements += memo->n_elements;
     }
     context->frame_color = context->frame_color ? 0 : 1;
 
-    u32 sorted[window->elements.n_items];
-    sort_indices(sorted, window->elements.items, window->elements.n_items, a->config.layer < b->config.layer, ElementData);
-
-    // updating is done in reverse
-    for (i32 i = array_len(sorted) - 1; i >= 0; i--)
+    // text sizes and lines age out in batches, a sweep every frame would cost more than it frees
+    if ((++context->frame & (RIPPLE_TEXT_CACHE_FRAMES - 1)) == 0)
     {
-        ElementData* element = &window->elements.items[sorted[i]];
-        if (!element->update_state) continue;
-        ElementState* state = mapa_get(window->elements_states, &element->id);
-        if (!state) continue;
-        state->layout = element->calculated_layout;
-        update_element_state(state);
+        for (i32 text_i = 0; text_i < (i64)context->text_sizes.size; text_i++)
+        {
+            RippleTextSize* size = mapa_get_at_index(context->text_sizes, (u64)text_i);
+            if (size && context->frame - size->last_used >= RIPPLE_TEXT_CACHE_FRAMES)
+            {
+                mapa_remove_at_index(context->text_sizes, (u64)text_i);
+                text_i--;
+            }
+        }
+
+        for (i32 text_i = 0; text_i < (i64)context->text_lines.size; text_i++)
+        {
+            RippleTextLines* lines = mapa_get_at_index(context->text_lines, (u64)text_i);
+            if (lines && context->frame - lines->last_used >= RIPPLE_TEXT_CACHE_FRAMES)
+            {
+                context->n_live_lines -= lines->n_lines;
+                mapa_remove_at_index(context->text_lines, (u64)text_i);
+                text_i--;
+            }
+        }
+
+        for (i32 wrap_i = 0; wrap_i < (i64)context->wrap_widths.size; wrap_i++)
+        {
+            RippleWrapWidth* width = mapa_get_at_index(context->wrap_widths, (u64)wrap_i);
+            if (width && context->frame - width->last_used >= RIPPLE_TEXT_CACHE_FRAMES)
+            {
+                mapa_remove_at_index(context->wrap_widths, (u64)wrap_i);
+                wrap_i--;
+            }
+        }
+
+        // the lines that are still cached move into the other pool, the rest is dropped with this one
+        typeof(context->line_pools[0])* pool = &context->line_pools[context->line_pool];
+        if (pool->n_items > 2 * context->n_live_lines + 1024)
+        {
+            typeof(context->line_pools[0])* compacted = &context->line_pools[!context->line_pool];
+            vektor_clear(*compacted);
+            for (u64 text_i = 0; text_i < context->text_lines.size; text_i++)
+            {
+                RippleTextLines* lines = mapa_get_at_index(context->text_lines, text_i);
+                if (!lines) continue;
+                u32 first_line = compacted->n_items;
+                for (u32 i = 0; i < lines->n_lines; i++)
+                    vektor_add(*compacted, pool->items[lines->first_line + i]);
+                lines->first_line = first_line;
+            }
+            context->line_pool = !context->line_pool;
+        }
     }
 
+    _RIPPLE_STATS_LAP(state_sweep_ns);
+
     state->left.pressed = false;
     state->right.pressed = false;
     state->middle.pressed = false;
@@ -329,20 +885,54 @@ void ripple_submit(RippleContext* context, u32 width, u32 height, RippleRenderDa
     ripple_backend_render_begin(width, height);
 
     // while rendering is done normally
-    for (u32 i = 0; i < array_len(sorted); i++)
+    for (u32 i = 0; i < n_elements; i++)
     {
-        ElementData* element = &window->elements.items[sorted[i]];
-        if (!element->config.render_func) continue;
-        element->config.render_func(element->config, element->calculated_layout, window->user_data, render_data);
+        u32 element = sorted ? sorted[i] : i;
+        ElementRender* render = &window->elements.renders.items[element];
+        if (!render->render_func) continue;
+        RippleElementConfig config = {
+            .layout = window->elements.configs.items[element],
+            .render_func = render->render_func,
+            .render_data = render->render_data,
+            .render_data_size = render->render_data_size,
+            .layer = render->layer
+        };
+        render->render_func(config, window->elements.layouts.items[element], window->user_data, render_data);
     }
 
+    _RIPPLE_STATS_LAP(render_ns);
+
+    u32 n_instances = ripple_backend_instance_count();
     ripple_backend_render_end(render_data, (RippleColor){ 0 });
 
+    _RIPPLE_STATS_LAP(render_end_ns);
+
+    // replayed elements point into the pool, so this waits until they are rendered
+    if (window->memo_pools[window->memo_pool].nodes.n_items > 2 * n_memo_elements + 1024)
+        compact_memo_pool(window);
+
+    if (context->collect_stats)
+    {
+        context->stats.total_ns = lap_time - start_time;
+        context->stats.n_elements = n_elements;
+        context->stats.n_reused_layouts = n_reused_layouts;
+        context->stats.n_replayed_elements = context->n_replayed_elements;
+        context->stats.n_states = n_states;
+        context->stats.n_state_hits = context->n_state_hits;
+        context->stats.n_state_misses = context->n_state_misses;
+        context->stats.n_text_measures = context->n_text_measures;
+        context->stats.n_line_breaks = context->n_line_breaks;
+        context->stats.n_instances = n_instances;
+    }
+
     ripple_reset(context);
 }
 
+#undef _RIPPLE_STATS_LAP
+
 #define _I1 LINE_UNIQUE_VAR(_i)
-#define _for_each_child(el) u32 _I1 = 0; for (ElementData* child = el + 1; _I1 < el->n_children; child = &window->elements.items[child->next_sibling], _I1++ )
+#define _I2 LINE_UNIQUE_VAR(_end)
+#define _for_each_child(el) for (u32 _I1 = nodes[el].first_child_index, _I2 = _I1 + nodes[el].n_children, child; _I1 < _I2 && (child = child_indices[_I1], true); _I1++)
 
 #define APPLY_SIZING(var, value, grow, parent, child)\
 if (value._type == type)\
@@ -353,35 +943,20 @@ if (value._type == type)\
             var = (type == SVT_RELATIVE_PARENT ? parent : child) * ((f32)value._value / (f32)(2<<RIPPLE_FLOAT_PRECISION)); break;\
     }
 
-#define DIM(arg) (*(element->config.layout.direction ? &(arg).w : &(arg).h))
-#define OTHER_DIM(arg) (*(element->config.layout.direction ? &(arg).h : &(arg).w))
-#define MAX_DIM(arg) (*(element->config.layout.direction ? &(arg).max_w : &(arg).max_h))
-#define POS(arg) (*(element->config.layout.direction ? &(arg).x : &(arg).y))
-#define OTHER_POS(arg) (*(element->config.layout.direction ? &(arg).y : &(arg).x))
-#define LAYOUT_DIM(arg) (*(element->config.layout.direction ? &(arg).width : &(arg).height))
-#define LAYOUT_OTHER_DIM(arg) (*(element->config.layout.direction ? &(arg).height : &(arg).width))
-#define LAYOUT_POS(arg) (*(element->config.layout.direction ? &(arg).x : &(arg).y))
-#define LAYOUT_OTHER_POS(arg) (*(element->config.layout.direction ? &(arg).y : &(arg).x))
-
-static RenderedLayout element_calculate_children_bounds(ElementData* element)
-{
-    RippleWindow* window = &_ripple_context->current_window;
-    RenderedLayout layout = { 0 };
-    _for_each_child(element)
-    {
-        if (child->config.layout.fixed) continue;
-        if (LAYOUT_POS(child->config.layout)._type == SVT_GROW)
-            DIM(layout) += DIM(child->calculated_layout);
-        if (LAYOUT_OTHER_POS(child->config.layout)._type == SVT_GROW)
-            OTHER_DIM(layout) = max(OTHER_DIM(layout), OTHER_DIM(child->calculated_layout));
-    }
-    return layout;
-}
-
-static void element_apply_sizing(ElementData* element, RippleSizingValueType type, RenderedLayout parent, RenderedLayout children)
+// all of these expect the parent's layout direction in a local called direction
+#define DIM(arg) (*(direction ? &(arg).w : &(arg).h))
+#define OTHER_DIM(arg) (*(direction ? &(arg).h : &(arg).w))
+#define MAX_DIM(arg) (*(direction ? &(arg).max_w : &(arg).max_h))
+#define POS(arg) (*(direction ? &(arg).x : &(arg).y))
+#define OTHER_POS(arg) (*(direction ? &(arg).y : &(arg).x))
+#define LAYOUT_DIM(arg) (*(direction ? &(arg).width : &(arg).height))
+#define LAYOUT_OTHER_DIM(arg) (*(direction ? &(arg).height : &(arg).width))
+#define LAYOUT_POS(arg) (*(direction ? &(arg).x : &(arg).y))
+#define LAYOUT_OTHER_POS(arg) (*(direction ? &(arg).y : &(arg).x))
+
+static void element_apply_sizing(RippleElementLayoutConfig config, RenderedLayout* out_layout, RippleSizingValueType type, RenderedLayout parent, RenderedLayout children)
 {
-    RippleElementLayoutConfig config = element->config.layout;
-    RenderedLayout layout = element->calculated_layout;
+    RenderedLayout layout = *out_layout;
 
     APPLY_SIZING(layout.w, config.width, 0, parent.w, children.w);
     APPLY_SIZING(layout.max_w, config.max_width, I32_MAX, parent.w, children.w);
@@ -394,107 +969,137 @@ static void element_apply_sizing(ElementData* element, RippleSizingValueType typ
     APPLY_SIZING(layout.x, config.x, 0, parent.w, children.w);
     APPLY_SIZING(layout.y, config.y, 0, parent.h, children.h);
 
-    element->calculated_layout = layout;
+    *out_layout = layout;
 }
 
-static void element_position_children(ElementData* element)
+static void element_position_children(u32 element)
 {
     RippleWindow* window = &_ripple_context->current_window;
+    ElementNode* nodes = window->elements.nodes.items;
+    u32* child_indices = window->elements.child_indices.items;
+    RippleElementLayoutConfig* configs = window->elements.configs.items;
+    RenderedLayout* layouts = window->elements.layouts.items;
+    RippleChildLayoutDirection direction = configs[element].direction;
+    RenderedLayout parent = layouts[element];
+
     u32 offset = 0;
     _for_each_child(element) {
-        if (child->config.layout.fixed) continue;
-        if (LAYOUT_POS(child->config.layout)._type != SVT_GROW)
+        if (configs[child].fixed) continue;
+        if (LAYOUT_POS(configs[child])._type != SVT_GROW)
         {
-            POS(child->calculated_layout) += POS(element->calculated_layout);
+            POS(layouts[child]) += POS(parent);
         }
         else
         {
-            POS(child->calculated_layout) = POS(element->calculated_layout) + offset;
-            offset += DIM(child->calculated_layout);
+            POS(layouts[child]) = POS(parent) + offset;
+            offset += DIM(layouts[child]);
         }
 
-        if (LAYOUT_OTHER_POS(child->config.layout)._type != SVT_GROW)
+        if (LAYOUT_OTHER_POS(configs[child])._type != SVT_GROW)
         {
-            OTHER_POS(child->calculated_layout) += OTHER_POS(element->calculated_layout);
+            OTHER_POS(layouts[child]) += OTHER_POS(parent);
         }
         else
         {
-            OTHER_POS(child->calculated_layout) = OTHER_POS(element->calculated_layout);
+            OTHER_POS(layouts[child]) = OTHER_POS(parent);
         }
     }
 }
 
-static void element_grow_children(ElementData* element)
+static int _ripple_compare_i32(const void* a, const void* b)
+{
+    i32 x = *(const i32*)a, y = *(const i32*)b;
+    return (x > y) - (x < y);
+}
+
+// water-fills the free space into GROW children: every growable child ends up at the same level
+// (clamped to its own size and max), the remainder is handed out one pixel at a time in sibling order
+static void element_grow_children(u32 element)
 {
     RippleWindow* window = &_ripple_context->current_window;
-    if (element->n_children == 0)
+    ElementNode* nodes = window->elements.nodes.items;
+    if (nodes[element].n_children == 0)
         return;
 
-    u32 free_space = (u32)DIM(element->calculated_layout);
+    u32* child_indices = window->elements.child_indices.items;
+    RippleElementLayoutConfig* configs = window->elements.configs.items;
+    RenderedLayout* layouts = window->elements.layouts.items;
+    RippleChildLayoutDirection direction = configs[element].direction;
+
+    #define grows (LAYOUT_DIM(configs[child])._type == SVT_GROW && !configs[child].fixed && DIM(layouts[child]) < MAX_DIM(layouts[child]))
+
+    i64 free_space = DIM(layouts[element]);
+    vektor_clear(window->grow_starts);
+    vektor_clear(window->grow_ends);
     _for_each_child(element) {
-        if (child->config.layout.fixed) continue;
-        free_space = free_space >= (u32)DIM(child->calculated_layout) ? free_space - (u32)DIM(child->calculated_layout) : 0;
+        if (configs[child].fixed) continue;
+        free_space -= DIM(layouts[child]);
+        if (!grows) continue;
+        vektor_add(window->grow_starts, DIM(layouts[child]));
+        vektor_add(window->grow_ends, MAX_DIM(layouts[child]));
     }
 
-    while(free_space > 0)
+    u32 n_growing = window->grow_starts.n_items;
+    if (free_space > 0 && n_growing > 0)
     {
-        #define doest_grow_or_fixed_or_max_width (LAYOUT_DIM(child->config.layout))._type != SVT_GROW || child->config.layout.fixed || DIM(child->calculated_layout) >= MAX_DIM(child->calculated_layout)
-
-        u32 smallest_width = free_space;
-        u32 second_smallest_width = free_space; // others are then resized to this
-        _for_each_child(element) {
-            if (doest_grow_or_fixed_or_max_width) continue;
+        i32* starts = window->grow_starts.items;
+        i32* ends = window->grow_ends.items;
+        qsort(starts, n_growing, sizeof(*starts), _ripple_compare_i32);
+        qsort(ends, n_growing, sizeof(*ends), _ripple_compare_i32);
+
+        // sweep the level up through the points where children start or stop growing
+        i64 level = starts[0];
+        u32 n_active = 0;
+        for (u32 start_i = 0, end_i = 0;;)
+        {
+            while (start_i < n_growing && starts[start_i] <= level) { n_active++; start_i++; }
+            while (end_i < n_growing && ends[end_i] <= level) { n_active--; end_i++; }
 
-            if ((u32)DIM(child->calculated_layout) < smallest_width)
+            i64 next_level = min(start_i < n_growing ? starts[start_i] : I64_MAX, end_i < n_growing ? ends[end_i] : I64_MAX);
+            if (n_active == 0)
             {
-                second_smallest_width = smallest_width;
-                smallest_width = (u32)DIM(child->calculated_layout);
+                if (next_level == I64_MAX) break;
+                level = next_level;
+                continue;
             }
-            else if ((u32)DIM(child->calculated_layout) < second_smallest_width && ((u32)DIM(child->calculated_layout)) != smallest_width)
-                second_smallest_width = (u32)DIM(child->calculated_layout);
 
-            if ((u32)MAX_DIM(child->calculated_layout) <= second_smallest_width)
-                second_smallest_width = (u32)MAX_DIM(child->calculated_layout);
-        }
-
-        u32 n_smallest = 0;
-        _for_each_child(element) {
-            if (doest_grow_or_fixed_or_max_width || (u32)DIM(child->calculated_layout) != smallest_width) continue;
-            n_smallest += 1;
-        }
-
-        if (n_smallest == 0)
-            break;
+            if (next_level == I64_MAX || (next_level - level) * n_active >= free_space)
+            {
+                i64 step = free_space / n_active;
+                level += step;
+                free_space -= step * n_active;
+                break;
+            }
 
-        u32 size_diff = second_smallest_width - smallest_width;
-        u32 amount_to_add = min(size_diff, free_space / n_smallest);
-        _for_each_child(element) {
-            if (doest_grow_or_fixed_or_max_width || (u32)DIM(child->calculated_layout) != smallest_width) continue;
-            DIM(child->calculated_layout) += amount_to_add;
+            free_space -= (next_level - level) * n_active;
+            level = next_level;
         }
 
-        smallest_width += amount_to_add;
-
-        // distribute the remainder
-        u32 remaining_after_rounding = min(size_diff * n_smallest, free_space) - amount_to_add * n_smallest;
         _for_each_child(element) {
-            if (doest_grow_or_fixed_or_max_width || (u32)DIM(child->calculated_layout) != smallest_width) continue;
-            if (remaining_after_rounding-- == 0) break;
-            child->calculated_layout.w += 1;
+            if (!grows) continue;
+            i32 size = DIM(layouts[child]);
+            i32 max_size = MAX_DIM(layouts[child]);
+            DIM(layouts[child]) = (i32)max(size, min(level, max_size));
+            // distribute the remainder
+            if (free_space > 0 && size <= level && level < max_size)
+            {
+                DIM(layouts[child]) += 1;
+                free_space--;
+            }
         }
-
-        free_space -= second_smallest_width;
-        #undef doest_grow_or_fixed_or_max_width
     }
 
+    #undef grows
+
     _for_each_child(element) {
-        if (child->config.layout.fixed || LAYOUT_OTHER_DIM(child->config.layout)._type != SVT_GROW) continue;
-        OTHER_DIM(child->calculated_layout) = OTHER_DIM(element->calculated_layout);
+        if (configs[child].fixed || LAYOUT_OTHER_DIM(configs[child])._type != SVT_GROW) continue;
+        OTHER_DIM(layouts[child]) = OTHER_DIM(layouts[element]);
     }
 
 }
 
-static void update_element_state(ElementState* state)
+// hovered comes from the hit test in ripple_submit
+static void update_element_state(ElementState* state, bool hovered)
 {
     RippleWindow* window = &_ripple_context->current_window;
     if (!window->cursor_state.valid)
@@ -502,19 +1107,11 @@ static void update_element_state(ElementState* state)
         state->state = (RippleElementState){ 0 };
         return;
     }
-    state->state.hovered = !window->cursor_state.consumed && (
-        window->cursor_state.x >= state->layout.x && window->cursor_state.x < state->layout.x + state->layout.w &&
-        window->cursor_state.y >= state->layout.y && window->cursor_state.y < state->layout.y + state->layout.h
-    );
+    state->state.hovered = hovered;
 
     state->state.clicked = state->state.hovered && window->cursor_state.left.pressed;
     state->state.released = state->state.hovered && window->cursor_state.left.released;
 
-    if (state->state.hovered)
-    {
-        window->cursor_state.consumed = true;
-    }
-
     state->state.is_held      = (window->cursor_state.left.pressed && state->state.clicked) ||
                                 (window->cursor_state.left.held && state->state.is_held);
     state->state.is_weak_held = state->state.hovered &&
@@ -522,33 +1119,116 @@ static void update_element_state(ElementState* state)
                                  (window->cursor_state.left.held && state->state.is_held));
 }
 
-static void finalize_element(ElementData* element)
+// copies the sibling list built by ripple_submit_element into one contiguous range of child_indices,
+// so the passes below are plain linear scans
+static void gather_element_children(RippleWindow* window, u32 element)
+{
+    ElementNode* nodes = window->elements.nodes.items;
+    nodes[element].first_child_index = window->elements.child_indices.n_items;
+
+    // the first child is always pushed right after its parent
+    u32 child = element + 1;
+    for (u32 child_i = 0; child_i < nodes[element].n_children; child_i++, child = nodes[child].next_sibling)
+        vektor_add(window->elements.child_indices, child);
+}
+
+// sizes and positions the children of element, parents have to be finalized before their children
+static void finalize_element(u32 element)
 {
     RippleWindow* window = &_ripple_context->current_window;
+    ElementNode* nodes = window->elements.nodes.items;
+    u32* child_indices = window->elements.child_indices.items;
+    RippleElementLayoutConfig* configs = window->elements.configs.items;
+    RenderedLayout* layouts = window->elements.layouts.items;
     _for_each_child(element)
     {
-        element_apply_sizing(child, SVT_RELATIVE_PARENT, element->calculated_layout, (RenderedLayout){ 0 });
+        element_apply_sizing(configs[child], &layouts[child], SVT_RELATIVE_PARENT, layouts[element], (RenderedLayout){ 0 });
 
-        child->calculated_layout.w = clamp(child->calculated_layout.w, child->calculated_layout.min_w, child->calculated_layout.max_w);
-        child->calculated_layout.h = clamp(child->calculated_layout.h, child->calculated_layout.min_h, child->calculated_layout.max_h);
+        layouts[child].w = clamp(layouts[child].w, layouts[child].min_w, layouts[child].max_w);
+        layouts[child].h = clamp(layouts[child].h, layouts[child].min_h, layouts[child].max_h);
 
-        if (element->config.layout.keep_inside)
+        if (configs[element].keep_inside)
         {
-            element->calculated_layout.x = clamp(element->calculated_layout.x, 0, (i32)window->width - element->calculated_layout.w);
-            element->calculated_layout.y = clamp(element->calculated_layout.y, 0, (i32)window->height - element->calculated_layout.h);
+            layouts[element].x = clamp(layouts[element].x, 0, (i32)window->width - layouts[element].w);
+            layouts[element].y = clamp(layouts[element].y, 0, (i32)window->height - layouts[element].h);
         }
     }
 
     element_grow_children(element);
 
+    // now that their width is final, wrapped text is as tall as its lines
+    if (nodes[element].wrapped_children)
+    {
+        ElementRender* renders = window->elements.renders.items;
+        _for_each_child(element)
+        {
+            if (!nodes[child].wrapped_text) continue;
+            RippleWrappedTextConfig* wrapped = renders[child].render_data;
+            i32 line_height;
+            i32 n_lines = (i32)ripple_text_lines(wrapped->text, wrapped->font_size, layouts[child].w, nullptr, &line_height);
+            layouts[child].h = clamp(n_lines * line_height, layouts[child].min_h, layouts[child].max_h);
+
+            RippleWrapWidth* last = mapa_get(_ripple_context->wrap_widths, &nodes[child].id);
+            if (!last) last = mapa_insert(_ripple_context->wrap_widths, &nodes[child].id, (RippleWrapWidth){ 0 });
+            *last = (RippleWrapWidth){ .width = layouts[child].w, .last_used = _ripple_context->frame };
+        }
+    }
+
     element_position_children(element);
 
-    for (u32 i = element->last_child; i != 0; i = window->elements.items[i].prev_sibling)
+    // children are matched with last frame's by id and position under the matched parent
+    u32 prev = nodes[element].prev_index;
+    ElementNode* prev_nodes = window->prev_elements.nodes.items;
+    u32* prev_child_indices = window->prev_elements.child_indices.items;
+    for (u32 child_i = 0; child_i < nodes[element].n_children; child_i++)
     {
-        finalize_element(&window->elements.items[i]);
+        u32 child = child_indices[nodes[element].first_child_index + child_i];
+        nodes[child].prev_index = U32_MAX;
+        if (prev == U32_MAX || child_i >= prev_nodes[prev].n_children) continue;
+
+        u32 prev_child = prev_child_indices[prev_nodes[prev].first_child_index + child_i];
+        if (prev_nodes[prev_child].id == nodes[child].id)
+            nodes[child].prev_index = prev_child;
     }
 }
 
+// if nothing that goes into laying out the subtree has changed since the last frame, its layouts are copied over
+static bool element_reuse_layouts(u32 element)
+{
+    RippleWindow* window = &_ripple_context->current_window;
+    ElementNode* node = &window->elements.nodes.items[element];
+    if (node->prev_index == U32_MAX)
+        return false;
+
+    ElementNode* prev = &window->prev_elements.nodes.items[node->prev_index];
+    if (prev->layout_hash != node->layout_hash || prev->subtree_size != node->subtree_size)
+        return false;
+
+    // the layout given to us by our parent is the only other input
+    RenderedLayout* layout = &window->elements.layouts.items[element];
+    RenderedLayout* prev_layout = &window->prev_elements.layouts.items[node->prev_index];
+    if (memcmp(layout, prev_layout, sizeof(*layout)) != 0)
+        return false;
+
+    memcpy(layout, prev_layout, node->subtree_size * sizeof(*layout));
+    return true;
+}
+
+// padding bits only ever cause a miss, the layout does not depend on them
+static u64 hash_layout_config(RippleElementLayoutConfig config)
+{
+    u64 words[(sizeof(config) + sizeof(u64) - 1) / sizeof(u64)] = { 0 };
+    memcpy(words, &config, sizeof(config));
+
+    // every word gets its own multiplier so they don't wait on each other, then one full mix
+    static const u64 keys[] = { 0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull, 0xD6E8FEB86659FD93ull, 0xFF51AFD7ED558CCDull };
+    _Static_assert(array_len(words) <= array_len(keys), "RippleElementLayoutConfig outgrew the multipliers in hash_layout_config");
+    u64 hash = 0;
+    for (u32 i = 0; i < array_len(words); i++)
+        hash += (words[i] ^ keys[i]) * keys[array_len(keys) - 1 - i];
+    return hash_u64(hash);
+}
+
 static u64 generate_element_id(u64 base, u64 parent_id, u32 index)
 {
     return hash_u64(hash_combine(base, hash_u64(parent_id + (u64)index * 1000)));
@@ -558,93 +1238,548 @@ static u64 generate_element_id(u64 base, u64 parent_id, u32 index)
 void ripple_push_id(u64 id)
 {
     RippleWindow* window = &_ripple_context->current_window;
-    ElementData* parent = &window->elements.items[window->current_element.index];
+    ElementNode* parent = &window->elements.nodes.items[window->current_element.index];
     window->current_element.id = id ? generate_element_id(id, window->current_element.id, parent->n_children) : id;
 
-    vektor_add(window->elements, (ElementData){
+    _ripple_add_element(window, (ElementNode){
         .parent_element = window->current_element.index,
         .id = window->current_element.id
     });
-    window->current_element.index = window->elements.n_items - 1;
+    window->current_element.index = window->elements.nodes.n_items - 1;
     window->current_element.state = nullptr;
 }
 
-void ripple_submit_element(RippleElementConfig config)
+static void _ripple_link_to_parent(RippleWindow* window, u32 index)
 {
-    RippleWindow* window = &_ripple_context->current_window;
-    ElementData* element = &window->elements.items[window->current_element.index];
-    ElementData* parent = &window->elements.items[element->parent_element];
+    ElementNode* parent = &window->elements.nodes.items[window->elements.nodes.items[index].parent_element];
+    parent->wrapped_children |= window->elements.nodes.items[index].wrapped_text;
     if (parent->n_children++ > 0)
     {
-        ElementData* child = &window->elements.items[parent->last_child];
-        child->next_sibling = window->current_element.index;
+        window->elements.nodes.items[parent->last_child].next_sibling = index;
     }
-    element->prev_sibling = parent->last_child;
-    parent->last_child = window->current_element.index;
+    parent->last_child = index;
+}
+
+void ripple_submit_element(RippleElementConfig config)
+{
+    RippleWindow* window = &_ripple_context->current_window;
+    u32 index = window->current_element.index;
+    ElementNode* element = &window->elements.nodes.items[index];
+    element->wrapped_text = config.render_func == render_wrapped_text;
+    _ripple_link_to_parent(window, index);
 
     // render_data is supposed to be set if render_data_size is also
     if (config.render_data_size)
-        config.render_data = allocator_make_copy((Allocator*)&_ripple_context->frame_allocator, config.render_data, config.render_data_size, 1);
+        config.render_data = allocator_make_copy(ripple_frame_allocator(), config.render_data, config.render_data_size, 1);
+
+    window->elements.configs.items[index] = config.layout;
+    // wrapped text takes the height of its lines once the width is known, whatever was asked for would only be overwritten
+    if (element->wrapped_text)
+        window->elements.configs.items[index].height = (RippleSizingValue){ ._type = SVT_PIXELS };
+    // the children's hashes are combined into this as they are popped
+    element->layout_hash = hash_layout_config(window->elements.configs.items[index]);
+    ElementRender* render = &window->elements.renders.items[index];
+    render->render_func = config.render_func;
+    render->render_data = config.render_data;
+    render->render_data_size = config.render_data_size;
+    render->layer = config.layer;
+}
+
+// unless wrapped text sizes itself, its width is only known once the parent is finalized. its last one is the best guess
+static i32 _ripple_popped_wrap_width(u64 id, RippleSizingValue width, i32 sized_width)
+{
+    if (width._type != SVT_GROW && width._type != SVT_RELATIVE_PARENT)
+        return sized_width;
+
+    RippleWrapWidth* last = mapa_get(_ripple_context->wrap_widths, &id);
+    if (!last) return I32_MAX;
+    last->last_used = _ripple_context->frame;
+    return last->width;
+}
 
-    element->config = config;
+// the parent's size can depend on our height, but the width is usually only final once the parent is finalized.
+// until then the width from last frame stands in, it goes into the hash so a change is never mistaken for a reusable layout
+static void _ripple_size_wrapped_text(RippleWindow* window, u32 index)
+{
+    ElementNode* element = &window->elements.nodes.items[index];
+    RenderedLayout* layout = &window->elements.layouts.items[index];
+    RippleWrappedTextConfig* wrapped = window->elements.renders.items[index].render_data;
+    i32 width = _ripple_popped_wrap_width(element->id, window->elements.configs.items[index].width, layout->w);
+
+    i32 line_height;
+    layout->h = (i32)ripple_text_lines(wrapped->text, wrapped->font_size, width, nullptr, &line_height) * line_height;
+    element->layout_hash = hash_combine(element->layout_hash, hash_combine(_ripple_hash_text(wrapped->text, wrapped->font_size), hash_u64((u32)width)));
+}
+
+// the sizing that only depends on the element and its children, done once all of them are popped
+static void _ripple_size_popped_element(RippleWindow* window, u32 index)
+{
+    ElementNode* element = &window->elements.nodes.items[index];
+    RippleElementLayoutConfig config = window->elements.configs.items[index];
+    RenderedLayout* layout = &window->elements.layouts.items[index];
+
+    element_apply_sizing(config, layout, SVT_GROW, (RenderedLayout){ 0 }, (RenderedLayout){ 0 });
+    element_apply_sizing(config, layout, SVT_PIXELS, (RenderedLayout){ 0 }, (RenderedLayout){ 0 });
+    RenderedLayout children = { .w = element->children_bounds.w, .h = element->children_bounds.h };
+    element_apply_sizing(config, layout, SVT_RELATIVE_CHILD, (RenderedLayout){ 0 }, children);
+
+    if (element->wrapped_text)
+        _ripple_size_wrapped_text(window, index);
+}
+
+static void _ripple_add_to_parent(RippleWindow* window, u32 index)
+{
+    ElementNode* element = &window->elements.nodes.items[index];
+    ElementNode* parent = &window->elements.nodes.items[element->parent_element];
+    RippleElementLayoutConfig config = window->elements.configs.items[index];
+    RenderedLayout* layout = &window->elements.layouts.items[index];
+
+    parent->layout_hash = hash_combine(parent->layout_hash, element->layout_hash);
+
+    // all of our children have been popped already, so now we add ourselves to the parent's bounds
+    if (!config.fixed)
+    {
+        RippleChildLayoutDirection direction = window->elements.configs.items[element->parent_element].direction;
+        if (LAYOUT_POS(config)._type == SVT_GROW)
+            DIM(parent->children_bounds) += DIM(*layout);
+        if (LAYOUT_OTHER_POS(config)._type == SVT_GROW)
+            OTHER_DIM(parent->children_bounds) = max(OTHER_DIM(parent->children_bounds), OTHER_DIM(*layout));
+    }
 }
 
 void ripple_pop_id(void)
 {
     RippleWindow* window = &_ripple_context->current_window;
-    ElementData *element = &window->elements.items[window->current_element.index];
-    ElementData *parent = &window->elements.items[element->parent_element];
+    u32 index = window->current_element.index;
 
-    element_apply_sizing(element, SVT_GROW, (RenderedLayout){ 0 }, (RenderedLayout){ 0 });
-    element_apply_sizing(element, SVT_PIXELS, (RenderedLayout){ 0 }, (RenderedLayout){ 0 });
-    RenderedLayout children = element_calculate_children_bounds(element);
-    element_apply_sizing(element, SVT_RELATIVE_CHILD, (RenderedLayout){ 0 }, children);
+    gather_element_children(window, index);
+    window->elements.nodes.items[index].subtree_size = window->elements.nodes.n_items - index;
+    _ripple_size_popped_element(window, index);
+    _ripple_add_to_parent(window, index);
 
+    ElementNode* element = &window->elements.nodes.items[index];
     window->current_element.index = element->parent_element;
-    window->current_element.id = parent->id;
+    window->current_element.id = window->elements.nodes.items[element->parent_element].id;
+}
+
+// element ids depend on the parent and on how many children it already has, and elements store the current layer
+static u64 _ripple_memo_key(RippleWindow* window, u64 id)
+{
+    u32 n_children = window->elements.nodes.items[window->current_element.index].n_children;
+    return hash_combine(hash_combine(id, window->current_element.id), hash_u64((u64)n_children << 32 | window->current_layer));
+}
+
+// recorded layouts are only good as long as the wrapped text in them would be broken at the same widths
+static u64 _ripple_memo_wrap_hash(ElementNode* nodes, RippleElementLayoutConfig* configs, RenderedLayout* layouts, u32 n_elements)
+{
+    u64 hash = 0;
+    for (u32 i = 0; i < n_elements; i++)
+    {
+        if (!nodes[i].wrapped_text) continue;
+        hash = hash_combine(hash, hash_u64((u32)_ripple_popped_wrap_width(nodes[i].id, configs[i].width, layouts[i].w)));
+    }
+    return hash;
+}
+
+// appends the elements recorded in memo to the current element as if its body had run again
+static void replay_memo(RippleWindow* window, RippleMemo* memo)
+{
+    RippleMemoPool* pool = &window->memo_pools[window->memo_pool];
+    u32 parent = window->current_element.index;
+    u32 base = window->elements.nodes.n_items;
+    u32 child_base = window->elements.child_indices.n_items;
+
+    for (u32 i = 0; i < memo->n_child_indices; i++)
+        vektor_add(window->elements.child_indices, base + pool->child_indices.items[memo->first_child_index + i]);
+
+    // render data keeps pointing into the pool
+    for (u32 i = 0; i < memo->n_elements; i++)
+    {
+        ElementNode node = pool->nodes.items[memo->first_element + i];
+        ElementRender render = pool->renders.items[memo->first_element + i];
+
+        bool top_level = node.parent_element == U32_MAX;
+        node.parent_element = top_level ? parent : base + node.parent_element;
+        node.next_sibling = node.next_sibling == U32_MAX ? 0 : base + node.next_sibling;
+        if (node.n_children) node.last_child += base;
+        node.first_child_index += child_base;
+
+        // everything recorded was popped already, so children_bounds, layout_hash and the layout are complete
+        u32 index = window->elements.nodes.n_items;
+        _ripple_add_element(window, node);
+        window->elements.configs.items[index] = pool->configs.items[memo->first_element + i];
+        window->elements.layouts.items[index] = pool->layouts.items[memo->first_element + i];
+        window->elements.renders.items[index] = render;
+        if (top_level)
+        {
+            window->elements.nodes.items[index].next_sibling = 0;
+            _ripple_link_to_parent(window, index);
+            _ripple_add_to_parent(window, index);
+        }
+
+        // elements whose state was used have to keep it alive
+        RippleStateSlot* slot = _ripple_resolve_state(window, render.state);
+        if (slot)
+        {
+            _ripple_touch_state(window, render.state.slot);
+            vektor_add(window->stateful_elements, index);
+            slot->state.element = index;
+            slot->state.state.first_render = false;
+        }
+    }
+
+    memo->_frame_color = _ripple_context->frame_color;
+    _ripple_context->n_replayed_elements += memo->n_elements;
+}
+
+bool ripple_memo_begin(u64 id, u64 deps_hash)
+{
+    RippleWindow* window = &_ripple_context->current_window;
+    u64 key = _ripple_memo_key(window, id);
+
+    RippleMemo* memo = mapa_get(window->memos, &key);
+    RippleMemoPool* pool = &window->memo_pools[window->memo_pool];
+    if (memo && memo->deps_hash == deps_hash &&
+        (!memo->wrap_hash || memo->wrap_hash == _ripple_memo_wrap_hash(&pool->nodes.items[memo->first_element], &pool->configs.items[memo->first_element], &pool->layouts.items[memo->first_element], memo->n_elements)))
+    {
+        replay_memo(window, memo);
+        return false;
+    }
+
+    vektor_add(window->open_memos, (typeof(*window->open_memos.items)){
+        .key = key,
+        .deps_hash = deps_hash,
+        .first_element = window->elements.nodes.n_items,
+        .first_child_index = window->elements.child_indices.n_items
+    });
+    return true;
+}
+
+static void* _ripple_memo_copy_render_data(RippleMemoRenderData* data, const void* render_data, usize size)
+{
+    Allocator* allocator = _ripple_context->allocators.elements;
+    if (size > RIPPLE_MEMO_BLOCK_SIZE)
+    {
+        void* copy = _ripple_alloc(allocator, size);
+        vektor_add(data->large, copy);
+        return memcpy(copy, render_data, size);
+    }
+
+    usize aligned_size = (size + 15) & ~(usize)15;
+    if (data->block == data->blocks.n_items || data->used + aligned_size > RIPPLE_MEMO_BLOCK_SIZE)
+    {
+        if (data->block < data->blocks.n_items) data->block++;
+        if (data->block == data->blocks.n_items) vektor_add(data->blocks, _ripple_alloc(allocator, RIPPLE_MEMO_BLOCK_SIZE));
+        data->used = 0;
+    }
+
+    void* copy = data->blocks.items[data->block] + data->used;
+    data->used += aligned_size;
+    return memcpy(copy, render_data, size);
+}
+
+// copies the render data and, for WORDS and WRAPPED_WORDS, the text it points at.
+// that is usually formatted into a frame allocator and gone by the time the memo is replayed
+static void* _ripple_memo_copy_render(RippleMemoRenderData* data, ElementRender render)
+{
+    void* copy = _ripple_memo_copy_render_data(data, render.render_data, render.render_data_size);
+    str* text = nullptr;
+    if (render.render_func == render_text) text = &((RippleTextConfig*)copy)->text;
+    else if (render.render_func == render_wrapped_text) text = &((RippleWrappedTextConfig*)copy)->text;
+    if (text && text->size) text->ptr = _ripple_memo_copy_render_data(data, text->ptr, text->size);
+    return copy;
+}
+
+static void _ripple_memo_reset_render_data(RippleMemoRenderData* data)
+{
+    for (u32 i = 0; i < data->large.n_items; i++)
+        _ripple_free(_ripple_context->allocators.elements, data->large.items[i]);
+    vektor_clear(data->large);
+    data->block = 0;
+    data->used = 0;
+}
+
+// copies everything the body submitted into the memo pool
+void ripple_memo_end(void)
+{
+    RippleWindow* window = &_ripple_context->current_window;
+    typeof(*window->open_memos.items) open = window->open_memos.items[--window->open_memos.n_items];
+    RippleMemoPool* pool = &window->memo_pools[window->memo_pool];
+    u32 base = open.first_element;
+
+    RippleMemo memo = {
+        .deps_hash = open.deps_hash,
+        .first_element = pool->nodes.n_items,
+        .n_elements = window->elements.nodes.n_items - base,
+        .first_child_index = pool->child_indices.n_items,
+        .n_child_indices = window->elements.child_indices.n_items - open.first_child_index,
+        .wrap_hash = _ripple_memo_wrap_hash(&window->elements.nodes.items[base], &window->elements.configs.items[base], &window->elements.layouts.items[base], window->elements.nodes.n_items - base),
+        ._frame_color = _ripple_context->frame_color
+    };
+
+    for (u32 i = 0; i < memo.n_child_indices; i++)
+        vektor_add(pool->child_indices, window->elements.child_indices.items[open.first_child_index + i] - base);
+
+    for (u32 i = base; i < window->elements.nodes.n_items; i++)
+    {
+        ElementNode node = window->elements.nodes.items[i];
+        node.parent_element = node.parent_element < base ? U32_MAX : node.parent_element - base;
+        node.next_sibling = node.next_sibling < base ? U32_MAX : node.next_sibling - base;
+        if (node.n_children) node.last_child -= base;
+        node.first_child_index -= open.first_child_index;
+
+        ElementRender render = window->elements.renders.items[i];
+        if (render.render_data_size)
+            render.render_data = _ripple_memo_copy_render(&pool->render_data, render);
+
+        vektor_add(pool->nodes, node);
+        vektor_add(pool->configs, window->elements.configs.items[i]);
+        vektor_add(pool->layouts, window->elements.layouts.items[i]);
+        vektor_add(pool->renders, render);
+    }
+
+    // the old range stays in the pool until it is compacted
+    RippleMemo* existing = mapa_get(window->memos, &open.key);
+    if (existing) *existing = memo;
+    else mapa_insert(window->memos, &open.key, memo);
+}
+
+// moves the ranges of the memos that are still alive into the other pool and drops the rest
+static void compact_memo_pool(RippleWindow* window)
+{
+    RippleMemoPool* pool = &window->memo_pools[window->memo_pool];
+    RippleMemoPool* compacted = &window->memo_pools[!window->memo_pool];
+    vektor_clear(compacted->nodes);
+    vektor_clear(compacted->configs);
+    vektor_clear(compacted->layouts);
+    vektor_clear(compacted->renders);
+    vektor_clear(compacted->child_indices);
+    _ripple_memo_reset_render_data(&compacted->render_data);
+
+    for (u64 memo_i = 0; memo_i < window->memos.size; memo_i++)
+    {
+        RippleMemo* memo = mapa_get_at_index(window->memos, memo_i);
+        if (!memo) continue;
+
+        for (u32 i = 0; i < memo->n_child_indices; i++)
+            vektor_add(compacted->child_indices, pool->child_indices.items[memo->first_child_index + i]);
+
+        for (u32 i = 0; i < memo->n_elements; i++)
+        {
+            ElementRender render = pool->renders.items[memo->first_element + i];
+            if (render.render_data_size)
+                render.render_data = _ripple_memo_copy_render(&compacted->render_data, render);
+            vektor_add(compacted->nodes, pool->nodes.items[memo->first_element + i]);
+            vektor_add(compacted->configs, pool->configs.items[memo->first_element + i]);
+            vektor_add(compacted->layouts, pool->layouts.items[memo->first_element + i]);
+            vektor_add(compacted->renders, render);
+        }
+
+        memo->first_element = compacted->nodes.n_items - memo->n_elements;
+        memo->first_child_index = compacted->child_indices.n_items - memo->n_child_indices;
+    }
+
+    window->memo_pool = !window->memo_pool;
 }
 
 #undef DIM
+#undef OTHER_DIM
 #undef MAX_DIM
 #undef POS
 #undef OTHER_POS
 #undef LAYOUT_DIM
-#undef LAYOUT_MAX_DIM
-#undef LAYOUT_MIN_DIM
+#undef LAYOUT_OTHER_DIM
+#undef LAYOUT_POS
+#undef LAYOUT_OTHER_POS
 
 #undef APPLY_SIZING
 
 #undef _for_each_child
+#undef _I2
 
 #endif // RIPPLE_IMPLEMENTATION
 
-// TODO: cache this somehow
+// allocations that are not in a vektor or mapa, aligned to 16 bytes
+static void* _ripple_alloc(Allocator* allocator, usize size)
+{
+    return allocator ? allocator_alloc(allocator, size, 16) : malloc(size);
+}
+
+static void _ripple_free(Allocator* allocator, void* data)
+{
+    if (allocator) allocator_free(allocator, data);
+    else free(data);
+}
+
+static RippleStateSlot* _ripple_state_slot(RippleWindow* window, u32 slot)
+{
+    return &window->elements_states.pages.items[slot / RIPPLE_STATE_PAGE_SIZE][slot % RIPPLE_STATE_PAGE_SIZE];
+}
+
+static RippleStateAlloc* _ripple_state_alloc_of(RippleWindow* window, u32 slot)
+{
+    return &window->elements_states.alloc_pages.items[slot / RIPPLE_STATE_PAGE_SIZE][slot % RIPPLE_STATE_PAGE_SIZE];
+}
+
+// nullptr if the state was evicted since the handle was made
+static RippleStateSlot* _ripple_resolve_state(RippleWindow* window, RippleStateHandle handle)
+{
+    if (!handle.generation) return nullptr;
+    RippleStateSlot* slot = _ripple_state_slot(window, handle.slot);
+    return slot->generation == handle.generation ? slot : nullptr;
+}
+
+// marks the state as used this frame, so ripple_submit updates it and does not evict it
+static void _ripple_touch_state(RippleWindow* window, u32 slot)
+{
+    RippleStateSlot* state_slot = _ripple_state_slot(window, slot);
+    if (state_slot->last_frame == window->elements_states.frame) return;
+    state_slot->last_frame = window->elements_states.frame;
+    vektor_add(window->elements_states.touched, slot);
+}
+
+static u32 _ripple_insert_state(RippleWindow* window, u64 id)
+{
+    typeof(window->elements_states)* states = &window->elements_states;
+
+    u32 slot;
+    if (states->free_slots.n_items)
+    {
+        slot = states->free_slots.items[--states->free_slots.n_items];
+    }
+    else
+    {
+        if (states->n_slots % RIPPLE_STATE_PAGE_SIZE == 0)
+        {
+            vektor_add(states->pages, _ripple_alloc(_ripple_context->allocators.states, sizeof(RippleStateSlot) * RIPPLE_STATE_PAGE_SIZE));
+            vektor_add(states->alloc_pages, _ripple_alloc(_ripple_context->allocators.states, sizeof(RippleStateAlloc) * RIPPLE_STATE_PAGE_SIZE));
+        }
+        slot = states->n_slots++;
+        _ripple_state_slot(window, slot)->generation = 1;
+    }
+
+    RippleStateSlot* state_slot = _ripple_state_slot(window, slot);
+    state_slot->state = (ElementState){ .state.first_render = true };
+    state_slot->id = id;
+    state_slot->last_frame = states->frame - 1;
+    _ripple_state_alloc_of(window, slot)->data = nullptr;
+    mapa_insert(states->slots, &id, slot);
+    return slot;
+}
+
 static ElementState* _get_or_insert_current_element_state(void)
 {
     RippleWindow* window = &_ripple_context->current_window;
     if (window->current_element.state)
         return window->current_element.state;
 
-    ElementState* state = mapa_get(window->elements_states, &window->current_element.id);
-    if (!state)
+    // an unchanged tree pushes every element at the same index as last frame, so the state that index used is checked first
+    u64 id = window->current_element.id;
+    u32 index = window->current_element.index;
+    RippleStateHandle cached = index < window->prev_elements.renders.n_items ? window->prev_elements.renders.items[index].state : (RippleStateHandle){ 0 };
+    RippleStateSlot* state_slot = _ripple_resolve_state(window, cached);
+    u32 slot = cached.slot;
+    if (state_slot && state_slot->id == id)
+    {
+        _ripple_context->n_state_hits++;
+        state_slot->state.state.first_render = false;
+    }
+    else
+    {
+        _ripple_context->n_state_misses++;
+        u32* found = mapa_get(window->elements_states.slots, &id);
+        slot = found ? *found : _ripple_insert_state(window, id);
+        state_slot = _ripple_state_slot(window, slot);
+        if (found)
+            state_slot->state.state.first_render = false;
+    }
+
+    _ripple_touch_state(window, slot);
+    vektor_add(window->stateful_elements, index);
+    window->elements.renders.items[index].state = (RippleStateHandle){ slot, state_slot->generation };
+    state_slot->state.element = index;
+    window->current_element.state = &state_slot->state;
+    return &state_slot->state;
+}
+
+static u32 _ripple_arena_size_class(usize size)
+{
+    u32 size_class = 0;
+    while (((usize)16 << size_class) < size) size_class++;
+    return size_class;
+}
+
+static void* _ripple_arena_alloc(RippleStateArena* arena, usize size)
+{
+    u32 size_class = _ripple_arena_size_class(size);
+    if (size_class >= RIPPLE_STATE_ARENA_N_CLASSES)
+        return _ripple_alloc(_ripple_context->allocators.states, size);
+
+    void* data = arena->free_lists[size_class];
+    if (data)
+    {
+        arena->free_lists[size_class] = *(void**)data;
+        return data;
+    }
+
+    usize class_size = (usize)16 << size_class;
+    if (arena->remaining < class_size)
+    {
+        u8* block = _ripple_alloc(_ripple_context->allocators.states, RIPPLE_STATE_ARENA_BLOCK_SIZE);
+        vektor_add(arena->blocks, block);
+        arena->cursor = block;
+        arena->remaining = RIPPLE_STATE_ARENA_BLOCK_SIZE;
+    }
+    data = arena->cursor;
+    arena->cursor += class_size;
+    arena->remaining -= class_size;
+    return data;
+}
+
+static void _ripple_free_state_alloc(RippleWindow* window, RippleStateAlloc* alloc)
+{
+    if (alloc->destructor) alloc->destructor(alloc->data);
+
+    RippleStateArena* arena = &window->elements_states.arena;
+    u32 size_class = _ripple_arena_size_class(alloc->size);
+    if (size_class >= RIPPLE_STATE_ARENA_N_CLASSES)
     {
-        state = mapa_insert(window->elements_states, &window->current_element.id, (ElementState){ 0 });
-        state->state.first_render = true;
+        _ripple_free(_ripple_context->allocators.states, alloc->data);
     }
     else
     {
-        state->state.first_render = false;
+        *(void**)alloc->data = arena->free_lists[size_class];
+        arena->free_lists[size_class] = alloc->data;
     }
+    alloc->data = nullptr;
+}
+
+// zeroed the first time, then the same memory every frame until the element dies. asking for a different size starts over
+static inline void* _ripple_state_alloc(usize size, state_destructor_t* destructor)
+{
+    RippleWindow* window = &_ripple_context->current_window;
+    _get_or_insert_current_element_state();
+    RippleStateAlloc* alloc = _ripple_state_alloc_of(window, window->elements.renders.items[window->current_element.index].state.slot);
+    if (alloc->data && alloc->size != size)
+        _ripple_free_state_alloc(window, alloc);
 
-    window->elements.items[window->current_element.index].update_state = true;
-    window->current_element.state = state;
-    state->state._frame_color = _ripple_context->frame_color;
-    return state;
+    if (!alloc->data)
+    {
+        alloc->data = _ripple_arena_alloc(&window->elements_states.arena, size);
+        memset(alloc->data, 0, size);
+        alloc->size = (u32)size;
+    }
+    alloc->destructor = destructor;
+    return alloc->data;
 }
 
 // the underlying field is a u64 so dont expect too much
 #define STATE_USER(type) *((type*)&_get_or_insert_current_element_state()->user_data)
 #define STATE_PTR() (_get_or_insert_current_element_state()->user_ptr)
+// for anything bigger, one allocation per element that lives as long as its state and is aligned to 16 bytes.
+// the destructor runs on it right before it is freed
+#define STATE_ALLOC(type) ((type*)_ripple_state_alloc(sizeof(type), nullptr))
+#define STATE_ALLOC_DESTRUCTOR(type, destructor) ((type*)_ripple_state_alloc(sizeof(type), (destructor)))
 #define STATE() (_get_or_insert_current_element_state()->state)
 #define SHAPE() (_get_or_insert_current_element_state()->layout)
 
@@ -656,6 +1791,37 @@ static ElementState* _get_or_insert_current_element_state(void)
 
 #define FORM(...) .layout = { __VA_ARGS__ }
 
+static inline u64 _ripple_hash_bytes(const void* data, usize size)
+{
+    const u8* bytes = data;
+    u64 hash = hash_u64(size);
+    for (usize i = 0; i < size; i += sizeof(u64))
+    {
+        u64 word = 0;
+        memcpy(&word, bytes + i, min(size - i, sizeof(u64)));
+        hash = hash_combine(hash, hash_u64(word));
+    }
+    return hash;
+}
+
+#define _RIPPLE_MEMO_DEP(dep) _ripple_hash_bytes((typeof(dep)[1]){ dep }, sizeof(dep))
+#define _RIPPLE_MEMO_DEPS_1(a) _RIPPLE_MEMO_DEP(a)
+#define _RIPPLE_MEMO_DEPS_2(a, ...) hash_combine(_RIPPLE_MEMO_DEP(a), _RIPPLE_MEMO_DEPS_1(__VA_ARGS__))
+#define _RIPPLE_MEMO_DEPS_3(a, ...) hash_combine(_RIPPLE_MEMO_DEP(a), _RIPPLE_MEMO_DEPS_2(__VA_ARGS__))
+#define _RIPPLE_MEMO_DEPS_4(a, ...) hash_combine(_RIPPLE_MEMO_DEP(a), _RIPPLE_MEMO_DEPS_3(__VA_ARGS__))
+#define _RIPPLE_MEMO_DEPS_5(a, ...) hash_combine(_RIPPLE_MEMO_DEP(a), _RIPPLE_MEMO_DEPS_4(__VA_ARGS__))
+#define _RIPPLE_MEMO_DEPS_6(a, ...) hash_combine(_RIPPLE_MEMO_DEP(a), _RIPPLE_MEMO_DEPS_5(__VA_ARGS__))
+#define _RIPPLE_MEMO_DEPS_7(a, ...) hash_combine(_RIPPLE_MEMO_DEP(a), _RIPPLE_MEMO_DEPS_6(__VA_ARGS__))
+#define _RIPPLE_MEMO_DEPS_8(a, ...) hash_combine(_RIPPLE_MEMO_DEP(a), _RIPPLE_MEMO_DEPS_7(__VA_ARGS__))
+#define _RIPPLE_MEMO_DEPS_N(_1, _2, _3, _4, _5, _6, _7, _8, N, ...) _RIPPLE_MEMO_DEPS_##N
+#define _RIPPLE_MEMO_DEPS(...) _RIPPLE_MEMO_DEPS_N(__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1)(__VA_ARGS__)
+
+// runs its body only when one of the deps (1 to 8 values of any non array type, compared by their bytes) changed,
+// otherwise the elements it submitted the last time are replayed. the body must not depend on anything else,
+// including STATE() of the elements inside it. render data is copied, and so is the text of WORDS and WRAPPED_WORDS,
+// but anything else it points at (images, strings of custom render functions) has to outlive the memo
+#define RIPPLE_MEMO(...) for (u8 LINE_UNIQUE_VAR(_ripplememo) = ripple_memo_begin(LINE_UNIQUE_HASH, _RIPPLE_MEMO_DEPS(__VA_ARGS__)) ? 0 : 1; LINE_UNIQUE_VAR(_ripplememo) < 1; ripple_memo_end(), LINE_UNIQUE_VAR(_ripplememo)++)
+
 #define CURSOR() (_ripple_context->current_window.cursor_state)
 
 #define RIPPLE_RAISE() for (u8 LINE_UNIQUE_VAR(_rippleiter) = (_ripple_context->current_window.current_layer++, 0); LINE_UNIQUE_VAR(_rippleiter) < 1; _ripple_context->current_window.current_layer--, LINE_UNIQUE_VAR(_rippleiter)++)
@@ -709,11 +1875,6 @@ void render_image(RippleElementConfig config, RenderedLayout layout, void* windo
   .render_data = &(RippleImageConfig){__VA_ARGS__},\
   .render_data_size = sizeof(RippleImageConfig)
 
-STRUCT(RippleTextConfig) {
-    RippleColor color;
-    str text;
-};
-
 void render_text(RippleElementConfig config, RenderedLayout layout, void* window_user_data, RippleRenderData user_data)
 {
     RippleTextConfig text_data = *(RippleTextConfig*)config.render_data;
@@ -727,6 +1888,24 @@ void render_text(RippleElementConfig config, RenderedLayout layout, void* window
   .render_data_size = sizeof(RippleTextConfig)
 #endif // WORDS
 
+void render_wrapped_text(RippleElementConfig config, RenderedLayout layout, void* window_user_data, RippleRenderData user_data)
+{
+    RippleWrappedTextConfig text_data = *(RippleWrappedTextConfig*)config.render_data;
+    RippleTextLine* lines; i32 line_height;
+    u32 n_lines = ripple_text_lines(text_data.text, text_data.font_size, layout.w, &lines, &line_height);
+    for (u32 i = 0; i < n_lines; i++)
+    {
+        str line = { .ptr = text_data.text.ptr + lines[i].start, .size = lines[i].size };
+        ripple_backend_render_text(layout.x, layout.y + (i32)i * line_height, line, text_data.font_size, text_data.color);
+    }
+}
+
+// breaks the text to the element's width and takes the height of its lines, the height in FORM is ignored
+#define WRAPPED_WORDS(...)\
+  .render_func = render_wrapped_text,\
+  .render_data = &(RippleWrappedTextConfig){__VA_ARGS__},\
+  .render_data_size = sizeof(RippleWrappedTextConfig)
+
 #define CENTERED_HORIZONTAL(...) do {\
         RIPPLE( FORM( .direction = cld_HORIZONTAL )) {\
             RIPPLE();\
@@ -12,10 +12,16 @@ RippleColor accent = { 0x00ADB5 };
 
 static inline void text(str text)
 {
-    i32 width, height; ripple_measure_text(text, font_size, &width, &height);
+    i32 width, height; ripple_text_size(text, font_size, &width, &height);
     RIPPLE( FORM( .width = PIXELS(width), .height = PIXELS(height) ), WORDS( .text = text, .color = light ));
 }
 
+// as wide as its parent, as tall as it needs to be
+static inline void wrapped_text(str text)
+{
+    RIPPLE( FORM( .width = GROW ), WRAPPED_WORDS( .text = text, .font_size = font_size, .color = light ));
+}
+
 static inline bool button(str label)
 {
     bool* open = nullptr;
@@ -145,7 +151,7 @@ static inline void color_picker(str label, HSV* color)
 #define RIPPLE_STOP_RAMP_BODY(lerp, to_rgb, selector, T)\
 bool changed = false;\
 u32 stop_w = 10;\
-u32 sorted[n_stops];\
+u32* sorted = allocator_alloc(ripple_frame_allocator(), sizeof(u32) * n_stops, _Alignof(u32));\
 sort_indices(sorted, stops, n_stops, a->t < b->t, T);\
 RIPPLE( FORM( .width = PIXELS(300), .height = PIXELS(32), .direction = cld_HORIZONTAL)) {\
     u32 x = SHAPE().x;\
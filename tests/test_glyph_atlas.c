@@ -0,0 +1,85 @@
+#include <printccy/printccy.h>
+#include <marrow/marrow.h>
+
+#define RIPPLE_BACKEND RIPPLE_WGPU
+#define RIPPLE_IMPLEMENTATION
+#include <ripple/ripple.h>
+
+#include <stdio.h>
+
+// nothing is drawn, the glyph atlas only needs webgpu calls that succeed
+WGPUTexture wgpuDeviceCreateTexture(WGPUDevice device, const WGPUTextureDescriptor* descriptor) { return nullptr; }
+WGPUTextureView wgpuTextureCreateView(WGPUTexture texture, const WGPUTextureViewDescriptor* descriptor) { return nullptr; }
+void wgpuTextureRelease(WGPUTexture texture) { }
+void wgpuTextureViewRelease(WGPUTextureView view) { }
+void wgpuQueueWriteTexture(WGPUQueue queue, const WGPUTexelCopyTextureInfo* destination, const void* data, size_t size, const WGPUTexelCopyBufferLayout* layout, const WGPUExtent3D* extent) { }
+void wgpuQueueWriteBuffer(WGPUQueue queue, WGPUBuffer buffer, uint64_t offset, const void* data, size_t size) { }
+WGPUBuffer wgpuDeviceCreateBuffer(WGPUDevice device, const WGPUBufferDescriptor* descriptor) { return nullptr; }
+void wgpuBufferRelease(WGPUBuffer buffer) { }
+WGPUBindGroupLayout wgpuDeviceCreateBindGroupLayout(WGPUDevice device, const WGPUBindGroupLayoutDescriptor* descriptor) { return nullptr; }
+WGPUBindGroup wgpuDeviceCreateBindGroup(WGPUDevice device, const WGPUBindGroupDescriptor* descriptor) { return nullptr; }
+void wgpuBindGroupRelease(WGPUBindGroup bind_group) { }
+WGPUSampler wgpuDeviceCreateSampler(WGPUDevice device, const WGPUSamplerDescriptor* descriptor) { return nullptr; }
+WGPUShaderModule wgpuDeviceCreateShaderModule(WGPUDevice device, const WGPUShaderModuleDescriptor* descriptor) { return nullptr; }
+void wgpuShaderModuleRelease(WGPUShaderModule module) { }
+WGPUPipelineLayout wgpuDeviceCreatePipelineLayout(WGPUDevice device, const WGPUPipelineLayoutDescriptor* descriptor) { return nullptr; }
+WGPURenderPipeline wgpuDeviceCreateRenderPipeline(WGPUDevice device, const WGPURenderPipelineDescriptor* descriptor) { return nullptr; }
+WGPURenderPassEncoder wgpuCommandEncoderBeginRenderPass(WGPUCommandEncoder encoder, const WGPURenderPassDescriptor* descriptor) { return nullptr; }
+void wgpuRenderPassEncoderSetPipeline(WGPURenderPassEncoder pass, WGPURenderPipeline pipeline) { }
+void wgpuRenderPassEncoderSetBindGroup(WGPURenderPassEncoder pass, uint32_t index, WGPUBindGroup group, size_t n_offsets, const uint32_t* offsets) { }
+void wgpuRenderPassEncoderSetVertexBuffer(WGPURenderPassEncoder pass, uint32_t slot, WGPUBuffer buffer, uint64_t offset, uint64_t size) { }
+void wgpuRenderPassEncoderDraw(WGPURenderPassEncoder pass, uint32_t n_vertices, uint32_t n_instances, uint32_t first_vertex, uint32_t first_instance) { }
+void wgpuRenderPassEncoderEnd(WGPURenderPassEncoder pass) { }
+void wgpuRenderPassEncoderRelease(WGPURenderPassEncoder pass) { }
+
+#define TEST_SMALL_GLYPHS 4096
+#define TEST_GLYPHS_PER_FRAME 64
+
+static bool overlap(_RippleGlyph a, _RippleGlyph b)
+{
+    return a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h && b.y < a.y + a.h;
+}
+
+static bool resident(_RippleGlyph* glyph)
+{
+    return glyph->shelf != U32_MAX && _context.font.shelves.items[glyph->shelf].generation == glyph->shelf_generation;
+}
+
+// fills every row of the glyph atlas with short shelves, then asks for a glyph taller than all of them
+int main(void)
+{
+    ripple_backend_renderer_initialize((RippleBackendRendererConfig){ 0 }, nullptr);
+    i32 index = stbtt_FindGlyphIndex(&_context.font.info, 'o');
+
+    static _RippleGlyph small[TEST_SMALL_GLYPHS];
+    u32 n_small = 0;
+    while (n_small < TEST_SMALL_GLYPHS && _context.stats.n_glyphs_evicted == 0)
+    {
+        ripple_backend_render_begin(800, 600);
+        for (u32 i = 0; i < TEST_GLYPHS_PER_FRAME && n_small < TEST_SMALL_GLYPHS; i++, n_small++)
+        {
+            small[n_small] = (_RippleGlyph){ .index = index, .w = 40, .h = 30, .shelf = U32_MAX };
+            if (!_ripple_backend_glyph_resident(&small[n_small]))
+            {
+                printf("small glyph %u did not fit\n", n_small);
+                return 1;
+            }
+        }
+    }
+    printf("%u small glyphs on %u shelves, atlas %u rows\n", n_small, (u32)_context.font.shelves.n_items, _context.font.height);
+
+    // one small glyph is drawn in the same frame, its shelf can't be taken
+    ripple_backend_render_begin(800, 600);
+    _RippleGlyph* drawn = &small[n_small - 1];
+    bool ok = _ripple_backend_glyph_resident(drawn);
+
+    _RippleGlyph tall = { .index = index, .w = 40, .h = 200, .shelf = U32_MAX };
+    ok &= _ripple_backend_glyph_resident(&tall);
+    ok &= tall.y + tall.h <= BITMAP_SIZE;
+    ok &= resident(drawn) && !overlap(tall, *drawn);
+    for (u32 i = 0; i < n_small; i++)
+        ok &= !resident(&small[i]) || !overlap(tall, small[i]);
+
+    printf("glyph %u rows tall: %s (at %u,%u, %u shelves evicted)\n", tall.h, ok ? "ok" : "FAILED", tall.x, tall.y, _context.stats.n_glyphs_evicted);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,95 @@
+#include <printccy/printccy.h>
+#include <marrow/marrow.h>
+
+#define RIPPLE_BACKEND RIPPLE_EMPTY
+#define RIPPLE_IMPLEMENTATION
+#include <ripple/ripple.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_WIDTH 800
+#define TEST_HEIGHT 600
+
+static const char* words = "value 42";
+static const char* wrapped_words = "a formatted line that wraps";
+
+// formats into the frame allocator like mrw_format in a widget does, ripple_submit resets it
+static str frame_string(const char* text)
+{
+    usize size = strlen(text);
+    char* data = allocator_alloc(ripple_frame_allocator(), size, 1);
+    memcpy(data, text, size);
+    return (str){ .ptr = data, .size = size };
+}
+
+// the memo under test, plus one whose deps change every frame so the pool fills with dead ranges and gets compacted
+static void build(u32 frame)
+{
+    RIPPLE_MEMO(1)
+    {
+        RIPPLE( FORM( .width = PIXELS(100), .height = PIXELS(20) ), WORDS( .text = frame_string(words) ) );
+        RIPPLE( FORM( .width = PIXELS(100) ), WRAPPED_WORDS( .text = frame_string(wrapped_words), .font_size = 10.0f ) );
+    }
+
+    RIPPLE_MEMO(frame)
+    {
+        for (u32 i = 0; i < 1500; i++)
+        {
+            ripple_push_id(i + 1);
+            ripple_submit_element((RippleElementConfig){ FORM( .width = PIXELS(1), .height = PIXELS(1) ) });
+            ripple_pop_id();
+        }
+    }
+}
+
+// what the backend gets handed for the element drawn with render_func in the last submitted frame
+static str submitted_text(RippleContext* context, render_func_t* render_func)
+{
+    for (u32 i = 0; i < context->current_window.prev_elements.renders.n_items; i++)
+    {
+        ElementRender render = context->current_window.prev_elements.renders.items[i];
+        if (render.render_func != render_func) continue;
+        return render_func == render_text ? ((RippleTextConfig*)render.render_data)->text : ((RippleWrappedTextConfig*)render.render_data)->text;
+    }
+    return (str){ 0 };
+}
+
+static bool same(str text, const char* expected)
+{
+    return text.size == strlen(expected) && memcmp(text.ptr, expected, text.size) == 0;
+}
+
+int main(void)
+{
+    RippleContext context = ripple_initialize((RippleBackendRendererConfig){ 0 }, (RippleAllocatorConfig){ 0 });
+    ripple_make_active_context(&context);
+
+    bool ok = true;
+    u32 pool = context.current_window.memo_pool;
+    bool compacted = false;
+    u32 n_replayed = 0;
+    for (u32 frame = 0; frame < 8; frame++)
+    {
+        // the memory the first frame formatted into, overwritten before the memo replays
+        if (frame > 0)
+        {
+            char* garbage = allocator_alloc(ripple_frame_allocator(), 4096, 1);
+            memset(garbage, 'X', 4096);
+        }
+
+        build(frame);
+        n_replayed += context.n_replayed_elements;
+        ripple_submit(&context, TEST_WIDTH, TEST_HEIGHT, (RippleRenderData){ 0 });
+        compacted |= context.current_window.memo_pool != pool;
+
+        bool frame_ok = same(submitted_text(&context, render_text), words) && same(submitted_text(&context, render_wrapped_text), wrapped_words);
+        if (!frame_ok) printf("frame %u: replayed text does not match what was recorded\n", frame);
+        ok &= frame_ok;
+    }
+
+    printf("replayed %u elements, pool %scompacted\n", n_replayed, compacted ? "" : "not ");
+    ok &= n_replayed > 0 && compacted;
+    printf("memo text: %s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
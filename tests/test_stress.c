@@ -0,0 +1,92 @@
+#include <printccy/printccy.h>
+#include <marrow/marrow.h>
+
+#define RIPPLE_BACKEND RIPPLE_EMPTY
+#define RIPPLE_IMPLEMENTATION
+#include <ripple/ripple.h>
+
+#include <pthread.h>
+#include <stdio.h>
+
+#define TEST_WIDTH 1920
+#define TEST_HEIGHT 1080
+
+// the default main thread stack on linux, everything per element has to live on the heap
+#define TEST_STACK_SIZE (8 * 1024 * 1024)
+#define TEST_DEPTH 250000
+#define TEST_SIBLINGS 1000000
+
+static RenderedLayout recorded;
+static void record_layout(RippleElementConfig config, RenderedLayout layout, void* window_user_data, RippleRenderData render_data)
+{
+    recorded = layout;
+}
+
+// every level is offset one pixel from its parent, so the innermost element has to end up at x == depth
+static bool test_deep(RippleContext* context)
+{
+    for (u32 i = 0; i < TEST_DEPTH; i++)
+    {
+        ripple_push_id(i + 1);
+        ripple_submit_element((RippleElementConfig){
+            FORM( .width = PIXELS(10), .height = PIXELS(10), .x = PIXELS(1) ),
+            .render_func = i == TEST_DEPTH - 1 ? record_layout : nullptr
+        });
+    }
+    for (u32 i = 0; i < TEST_DEPTH; i++)
+        ripple_pop_id();
+
+    ripple_submit(context, TEST_WIDTH, TEST_HEIGHT, (RippleRenderData){ 0 });
+
+    bool ok = recorded.x == TEST_DEPTH && recorded.y == 0 && recorded.w == 10 && recorded.h == 10;
+    printf("%u levels deep: %s (innermost at %d,%d %dx%d)\n", TEST_DEPTH, ok ? "ok" : "FAILED",
+           recorded.x, recorded.y, recorded.w, recorded.h);
+    return ok;
+}
+
+// a million siblings spread over a few layers
+static bool test_wide(RippleContext* context)
+{
+    for (u32 i = 0; i < TEST_SIBLINGS; i++)
+    {
+        ripple_push_id(i + 1);
+        ripple_submit_element((RippleElementConfig){
+            .layer = (u8)(i % 4),
+            FORM( .width = PIXELS(10), .height = PIXELS(10), .x = PIXELS((i32)(i % TEST_WIDTH)) ),
+            .render_func = i == TEST_SIBLINGS - 1 ? record_layout : nullptr
+        });
+        ripple_pop_id();
+    }
+
+    ripple_submit(context, TEST_WIDTH, TEST_HEIGHT, (RippleRenderData){ 0 });
+
+    bool ok = context->current_window.prev_elements.nodes.n_items == TEST_SIBLINGS + 1 && recorded.x == (TEST_SIBLINGS - 1) % TEST_WIDTH;
+    printf("%u siblings: %s (last at %d,%d %dx%d)\n", TEST_SIBLINGS, ok ? "ok" : "FAILED",
+           recorded.x, recorded.y, recorded.w, recorded.h);
+    return ok;
+}
+
+static void* run(void* out_ok)
+{
+    RippleContext context = ripple_initialize((RippleBackendRendererConfig){ 0 }, (RippleAllocatorConfig){ 0 });
+    ripple_make_active_context(&context);
+    *(bool*)out_ok = test_deep(&context) & test_wide(&context);
+    return nullptr;
+}
+
+int main(void)
+{
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setstacksize(&attributes, TEST_STACK_SIZE);
+
+    bool ok = false;
+    pthread_t thread;
+    if (pthread_create(&thread, &attributes, run, &ok) != 0)
+    {
+        printf("could not start the test thread\n");
+        return 1;
+    }
+    pthread_join(thread, nullptr);
+    return ok ? 0 : 1;
+}